@@ -31,6 +31,7 @@
 
 #include "config.h"
 #include <check.h>
+#include <mpiglue.h>
 #include <mpi_utils.h>
 #include <matrices.h>
 #include <matrixio.h>
@@ -43,6 +44,7 @@
 typedef struct {
      int nx, ny, nz;
      real *data;
+     void *shared; /* mpi_node_shared_malloc handle, if data is shared */
 } epsilon_file_data;
 
 /* Linearly interpolate a given point in a 3d grid of data.  The point
@@ -139,17 +141,45 @@ void get_epsilon_file_func(const char *fname,
 	  int rank = 3, dims[3];
 
 	  CHK_MALLOC(d, epsilon_file_data, 1);
+	  d->shared = NULL;
 	  
 	  eps_fname = ctl_fix_path(fname);
 	  mpi_one_printf("Using background dielectric from file \"%s\"...\n",
 			 eps_fname);
-	  file_id = matrixio_open(eps_fname, 1);
+	  if (!node_shared_inputsp) {
+	       file_id = matrixio_open(eps_fname, 1);
+	       d->data = matrixio_read_real_data(file_id, NULL, &rank, dims,
+						 0,0,0, NULL);
+	       CHECK(d->data, "couldn't find dataset in dielectric file");
+	       matrixio_close(file_id);
+	  }
+	  else {
+	       /* read the file on one process per node, directly into
+		  the copy shared by the processes on the node */
+	       int node_master = mpi_is_node_master();
+	       size_t i, N = 1;
+
+	       if (node_master) {
+		    file_id = matrixio_open_serial(eps_fname, 1);
+		    CHECK(matrixio_read_real_data_dims(file_id, NULL,
+						       &rank, dims),
+			  "couldn't find dataset in dielectric file");
+	       }
+	       /* the master (rank 0) is always a node master: */
+	       MPI_Bcast(&rank, 1, MPI_INT, 0, mpb_comm);
+	       MPI_Bcast(dims, rank, MPI_INT, 0, mpb_comm);
+	       for (i = 0; i < (size_t) rank; ++i)
+		    N *= dims[i];
+	       d->data = (real *) mpi_node_shared_malloc(sizeof(real) * N,
+							 &d->shared);
+	       if (node_master) {
+		    matrixio_read_real_data(file_id, NULL, &rank, dims,
+					    dims[0], 0, 1, d->data);
+		    matrixio_close(file_id);
+	       }
+	       mpi_node_shared_sync(d->shared);
+	  }
 	  free(eps_fname);
-
-	  d->data = matrixio_read_real_data(file_id, NULL, &rank, dims,
-					    0,0,0, NULL);
-	  CHECK(d->data, "couldn't find dataset in dielectric file");
-	  matrixio_close(file_id);
 	  
 	  d->nx = rank >= 1 ? dims[0] : 1;
 	  d->ny = rank >= 2 ? dims[1] : 1;
@@ -171,7 +201,10 @@ void destroy_epsilon_file_func_data(void *func_data)
 {
      epsilon_file_data *d = (epsilon_file_data *) func_data;
      if (d) {
-	  free(d->data);
+	  if (d->shared)
+	       mpi_node_shared_free(d->shared);
+	  else
+	       free(d->data);
 	  free(d);
      }
 }
@@ -341,7 +341,7 @@ number_list compute_field_energy(void)
      retval.num_items = 7;
      CHK_MALLOC(retval.items, number, retval.num_items);
 
-     retval.items[0] = energy_sum * Vol / H.N;
+     retval.items[0] = energy_sum * Vol / mdata->N;
 
      for (i = 0; i < 6; ++i)
 	  retval.items[i+1] = comp_sum[i];
@@ -388,11 +388,19 @@ void compute_field_divergence(void)
      for (i = 0; i < mdata->other_dims; ++i)
           for (j = 0; j < mdata->last_dim; ++j) {
                int ij = i * mdata->last_dim_size + j;
-	       k_data cur_k = mdata->k_plus_G[ij];
+	       int ipw = MAXWELL_PLANEWAVE(mdata, i * mdata->last_dim + j);
+	       k_data cur_k;
+	       real kx, ky, kz;
+
+	       if (ipw < 0) { /* outside of the planewave cutoff */
+		    ASSIGN_ZERO(field2[ij]);
+		    continue;
+	       }
+	       cur_k = mdata->k_plus_G[ipw];
 	       /* k+G = |k+G| (m x n) */
-	       real kx = cur_k.kmag * (cur_k.my*cur_k.nz-cur_k.mz*cur_k.ny);
-	       real ky = cur_k.kmag * (cur_k.mz*cur_k.nx-cur_k.mx*cur_k.nz);
-	       real kz = cur_k.kmag * (cur_k.mx*cur_k.ny-cur_k.my*cur_k.nz);
+	       kx = cur_k.kmag * (cur_k.my*cur_k.nz-cur_k.mz*cur_k.ny);
+	       ky = cur_k.kmag * (cur_k.mz*cur_k.nx-cur_k.mx*cur_k.nz);
+	       kz = cur_k.kmag * (cur_k.mx*cur_k.ny-cur_k.my*cur_k.nz);
 	       ASSIGN_SCALAR(field2[ij],
 			     SCALAR_RE(field2[3*ij+0]) * kx +
 			     SCALAR_RE(field2[3*ij+1]) * ky +
@@ -407,7 +415,7 @@ void compute_field_divergence(void)
 
      /* multiply by i (from divergence) and normalization (from FFT)
         and 2*pi (from k+G) */
-     scale = TWOPI / H.N;
+     scale = TWOPI / mdata->N;
      N = mdata->fft_output_size;
      for (i = 0; i < N; ++i) {
 	  CASSIGN_SCALAR(curfield[i],
@@ -906,7 +914,7 @@ number compute_energy_in_dielectric(number eps_low, number eps_high)
      }
      mpi_allreduce_1(&energy_sum, real, SCALAR_MPI_TYPE,
 		     MPI_SUM, mpb_comm);
-     energy_sum *= Vol / H.N;
+     energy_sum *= Vol / mdata->N;
      return energy_sum;
 }
 
@@ -993,6 +1001,57 @@ static void output_scalarfield(real *vals,
 	  matrixio_close_dataset(data_id);
 }
 
+/* Set the part of the grid written by the fieldio routines from
+   output-region-center, output-region-size, and output-decimation: the
+   grid points inside the box, which is not wrapped around the periodic
+   cell, or, along a direction in which the box is thinner than the
+   grid spacing (e.g. has zero size, for a slice), the grid point
+   nearest its center.  The first and last grid points written are
+   returned in lo and hi; returns whether anything other than the
+   whole, undecimated grid is written.  The dimensions are in the order of
+   dims in output_field_to_file, where x and y are transposed with
+   MPI. */
+static int set_output_region(int lo[3], int hi[3])
+{
+     int n[3], i, whole = 1;
+     real c[3], s[3], L[3];
+
+     n[0] = mdata->nx; n[1] = mdata->ny; n[2] = mdata->nz;
+     c[0] = output_region_center.x; s[0] = output_region_size.x;
+     c[1] = output_region_center.y; s[1] = output_region_size.y;
+     c[2] = output_region_center.z; s[2] = output_region_size.z;
+     L[0] = geometry_lattice.size.x;
+     L[1] = geometry_lattice.size.y;
+     L[2] = geometry_lattice.size.z;
+
+     for (i = 0; i < 3; ++i) {
+	  /* grid point j is at the lattice coordinate (j/n - 0.5) * L */
+	  real a = ((c[i] - 0.5 * s[i]) / L[i] + 0.5) * n[i];
+	  real b = ((c[i] + 0.5 * s[i]) / L[i] + 0.5) * n[i];
+	  a = ceil(MAX2(a, 0) - 1e-6);
+	  b = floor(MIN2(b, n[i] - 1) + 1e-6);
+	  if (a <= b) {
+	       lo[i] = (int) a;
+	       hi[i] = (int) b;
+	  }
+	  else {
+	       real j = floor((c[i] / L[i] + 0.5) * n[i] + 0.5);
+	       j = j - n[i] * floor(j / n[i]); /* periodic */
+	       lo[i] = hi[i] = (int) j;
+	  }
+	  whole = whole && lo[i] == 0 && hi[i] == n[i] - 1;
+     }
+#ifdef HAVE_MPI
+     i = lo[0]; lo[0] = lo[1]; lo[1] = i;
+     i = hi[0]; hi[0] = hi[1]; hi[1] = i;
+#endif
+     if (whole)
+	  fieldio_set_region(NULL, NULL, output_decimation);
+     else
+	  fieldio_set_region(lo, hi, output_decimation);
+     return !whole || output_decimation > 1;
+}
+
 /* given the field in curfield, store it to HDF (or whatever) using
    the matrixio (fieldio) routines.  Allow the component to be specified
    (which_component 0/1/2 = x/y/z, -1 = all) for vector fields.
@@ -1005,6 +1064,8 @@ void output_field_to_file(integer which_component, string filename_prefix)
      int attr_dims[2] = {3, 3};
      real output_k[3]; /* kvector in reciprocal lattice basis */
      real output_R[3][3];
+     int region_lo[3], region_hi[3], is_region;
+     real region_origin[3] = {0,0,0};
 
      /* where to put "otherhalf" block of output, only used for real scalars */
      int last_dim_index = 0;
@@ -1018,6 +1079,8 @@ void output_field_to_file(integer which_component, string filename_prefix)
 	  return;
      }
 
+     is_region = set_output_region(region_lo, region_hi);
+
 #ifdef HAVE_MPI
      /* The first two dimensions (x and y) of the position-space fields
 	are transposed when we use MPI, so we need to transpose everything. */
@@ -1094,7 +1157,7 @@ void output_field_to_file(integer which_component, string filename_prefix)
      output_R[2][0]=R[2][0]; output_R[2][1]=R[2][1]; output_R[2][2]=R[2][2];
 #endif /* ! HAVE_MPI */
 
-     if (strchr("Rv", curfield_type)) /* generic scalar/vector field */
+     if (strchr("RvL", curfield_type)) /* generic scalar/vector field */
 	  output_k[0] = output_k[1] = output_k[2] = 0.0; /* don't know k */
 
      if (strchr("dhbecv", curfield_type)) { /* outputting vector field */
@@ -1208,7 +1271,7 @@ void output_field_to_file(integer which_component, string filename_prefix)
 	  matrixio_write_data_attr(file_id, "Bloch wavevector",
 				   output_k, 1, attr_dims);
      }
-     else if (strchr("DHBnmR", curfield_type)) { /* scalar field */
+     else if (strchr("DHBnmRL", curfield_type)) { /* scalar field */
 	  if (curfield_type == 'n') {
 	       sprintf(fname, "epsilon");
 	       sprintf(description, "dielectric function, epsilon");
@@ -1217,6 +1280,10 @@ void output_field_to_file(integer which_component, string filename_prefix)
 	       sprintf(fname, "mu");
 	       sprintf(description, "permeability mu");
 	  }
+	  else if (curfield_type == 'L') {
+	       sprintf(fname, "ldos");
+	       sprintf(description, "local density of states");
+	  }
 	  else {
 	       sprintf(fname, "%cpwr.k%02d.b%02d",
 		       tolower(curfield_type), kpoint_index, curfield_band);
@@ -1227,7 +1294,8 @@ void output_field_to_file(integer which_component, string filename_prefix)
 	  }
 	  fname2 = fix_fname(fname, filename_prefix, mdata,
 			     /* no parity suffix for epsilon: */
-			     curfield_type != 'n' && curfield_type != 'm');
+			     curfield_type != 'n' && curfield_type != 'm'
+			     && curfield_type != 'L');
 	  mpi_one_printf("Outputting %s...\n", fname2);
 	  file_id = matrixio_create(fname2);
 	  free(fname2);
@@ -1277,18 +1345,67 @@ void output_field_to_file(integer which_component, string filename_prefix)
 #endif
 			 }
 	  }
+	  else if (curfield_type == 'L') {
+	       int bin, nbins = ldos_num_bins();
+	       char dataname[100];
+	       real *bin_freqs;
+
+	       /* "data" is the LDOS integrated over frequency, and
+		  "ldos.bNNN" is the LDOS in each frequency bin: */
+	       CHK_MALLOC(bin_freqs, real, nbins);
+	       for (bin = 0; bin < nbins; ++bin) {
+		    bin_freqs[bin] = get_ldos(bin);
+		    sprintf(dataname, "ldos.b%03d", bin);
+		    output_scalarfield((real *) curfield, dims,
+				       local_dims, start,
+				       file_id, dataname,
+				       last_dim_index,
+				       last_dim_start, last_dim_size,
+				       first_dim_start,
+				       first_dim_size,
+				       write_start0_special);
+	       }
+	       if (nbins > 0)
+		    matrixio_write_data_attr(file_id, "frequencies",
+					     bin_freqs, 1, &nbins);
+	       free(bin_freqs);
+	  }
 
      }
      else
 	  mpi_one_fprintf(stderr, "unknown field type!\n");
 
+     /* for a region and/or decimation, describe the dataset actually
+	written: the lattice vectors are scaled to the extent of its grid
+	(its number of points times their spacing), and the "region
+	origin" attribute is the position of its first point, in the
+	same Cartesian coordinates as the lattice vectors (in which the
+	whole grid starts at minus half of each lattice vector) */
+     if (is_region) {
+	  int i, j;
+	  for (i = 0; i < 3; ++i) {
+	       int m = (region_hi[i] - region_lo[i]) / output_decimation + 1;
+	       for (j = 0; j < 3; ++j)
+		    region_origin[j] += (region_lo[i] * 1.0 / dims[i] - 0.5)
+			 * output_R[i][j];
+	       if (dims[i] > 1)
+		    for (j = 0; j < 3; ++j)
+			 output_R[i][j] *= (m * output_decimation * 1.0)
+			      / dims[i];
+	  }
+     }
+
      if (file_id.id >= 0) {
 	  matrixio_write_data_attr(file_id, "lattice vectors",
 				   &output_R[0][0], 2, attr_dims);
+	  if (is_region)
+	       matrixio_write_data_attr(file_id, "region origin",
+					region_origin, 1, attr_dims);
 	  matrixio_write_string_attr(file_id, "description", description);
 
 	  matrixio_close(file_id);
      }
+     fieldio_set_region(NULL, NULL, 1);
 
      /* We have destroyed curfield (by multiplying it by phases,
 	and/or reorganizing in the case of real-amplitude fields). */
@@ -1362,7 +1479,7 @@ number compute_energy_in_object_list(geometric_object_list objects)
 
      mpi_allreduce_1(&energy_sum, real, SCALAR_MPI_TYPE,
 		     MPI_SUM, mpb_comm);
-     energy_sum *= Vol / H.N;
+     energy_sum *= Vol / mdata->N;
      return energy_sum;
 }
 
@@ -1513,8 +1630,8 @@ cnumber compute_field_integral(function f)
 #endif
 	}}}
 
-     integral.re *= Vol / H.N;
-     integral.im *= Vol / H.N;
+     integral.re *= Vol / mdata->N;
+     integral.im *= Vol / mdata->N;
      {
 	  cnumber integral_sum;
 	  mpi_allreduce(&integral, &integral_sum, 2, number,
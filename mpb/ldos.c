@@ -0,0 +1,215 @@
+/* Copyright (C) 1999-2020 Massachusetts Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include <mpiglue.h>
+#include <mpi_utils.h>
+#include <check.h>
+
+#include "mpb.h"
+#include <ctl-io.h>
+#include <xyz_loop.h>
+#include <maxwell.h>
+
+/**************************************************************************/
+
+/* Local and projected density of states (see maxwell_ldos.c), in a
+   run over the k points: init-ldos sets up the bins, the accumulate-ldos
+   band function adds the bands of each k point, and output-ldos prints
+   the DOS and projected DOS and writes the LDOS. */
+
+static int ldos_nbins = 0, ldos_spatial = 0, ldos_N = 0;
+static real ldos_fmin, ldos_fmax, ldos_broadening;
+static geometric_object_list ldos_objects = { 0, 0 };
+static maxwell_ldos_data *ldos = NULL; /* allocated when the grid is known */
+
+static void destroy_ldos(void)
+{
+     int i;
+     for (i = 0; i < ldos_objects.num_items; ++i)
+	  geometric_object_destroy(ldos_objects.items[i]);
+     free(ldos_objects.items);
+     ldos_objects.num_items = 0;
+     ldos_objects.items = NULL;
+     destroy_maxwell_ldos_data(ldos);
+     ldos = NULL;
+     ldos_N = 0;
+}
+
+/* Start accumulating the DOS in nbins bins from fmin to fmax, with the
+   given Gaussian broadening (or none, if zero), and the LDOS if spatial
+   is true and the projected DOS if objects is not empty.  The arrays
+   are allocated by the first accumulate_ldos_kpoint, when the grid is
+   known. */
+void init_ldos(number fmin, number fmax, integer nbins, number broadening,
+	       boolean spatial, geometric_object_list objects)
+{
+     int i;
+
+     CHECK(nbins > 0 && fmax > fmin, "invalid LDOS frequency bins");
+     CHECK(broadening >= 0, "negative LDOS broadening");
+     destroy_ldos();
+     ldos_fmin = fmin;
+     ldos_fmax = fmax;
+     ldos_nbins = nbins;
+     ldos_broadening = broadening;
+     ldos_spatial = spatial;
+     ldos_objects.num_items = objects.num_items;
+     CHK_MALLOC(ldos_objects.items, geometric_object, objects.num_items);
+     for (i = 0; i < objects.num_items; ++i)
+	  geometric_object_copy(&objects.items[i], &ldos_objects.items[i]);
+}
+
+/* Allocate the LDOS data, with the mask of the projected DOS computed
+   as in compute_energy_in_object_list. */
+static void alloc_ldos(void)
+{
+     ldos_N = mdata->fft_output_size;
+     ldos = create_maxwell_ldos_data(mdata, ldos_nbins, ldos_fmin, ldos_fmax,
+				     ldos_broadening, ldos_spatial);
+
+     if (ldos_objects.num_items > 0) {
+	  int i, j, k, n1, n2, n3, n_other, n_last, rank;
+#ifdef HAVE_MPI
+	  int local_n2, local_y_start, local_n3;
+#endif
+	  real s1, s2, s3, c1, c2, c3, *mask;
+
+	  CHK_MALLOC(mask, real, mdata->fft_output_size);
+	  for (i = 0; i < mdata->fft_output_size; ++i)
+	       mask[i] = 0;
+	  ldos->mask = mask;
+	  geom_fix_objects0(ldos_objects);
+
+	  n1 = mdata->nx; n2 = mdata->ny; n3 = mdata->nz;
+	  n_other = mdata->other_dims;
+	  n_last = mdata->last_dim_size
+	       / (sizeof(scalar_complex)/sizeof(scalar));
+	  rank = (n3 == 1) ? (n2 == 1 ? 1 : 2) : 3;
+
+	  s1 = geometry_lattice.size.x / n1;
+	  s2 = geometry_lattice.size.y / n2;
+	  s3 = geometry_lattice.size.z / n3;
+	  c1 = n1 <= 1 ? 0 : geometry_lattice.size.x * 0.5;
+	  c2 = n2 <= 1 ? 0 : geometry_lattice.size.y * 0.5;
+	  c3 = n3 <= 1 ? 0 : geometry_lattice.size.z * 0.5;
+
+	  LOOP_XYZ(mdata) {
+	       vector3 p;
+	       int n;
+	       p.x = i1 * s1 - c1; p.y = i2 * s2 - c2; p.z = i3 * s3 - c3;
+	       for (n = ldos_objects.num_items - 1; n >= 0; --n)
+		    if (point_in_periodic_fixed_objectp(p,
+							ldos_objects.items[n])) {
+			 if (ldos_objects.items[n].material.which_subclass
+			     != MATERIAL_TYPE_SELF) /* else "nothing" */
+			      mask[xyz_index] = 1;
+			 break;
+		    }
+	  }}}
+     }
+}
+
+/* Add the contributions of all of the bands at the current k point,
+   times weight (e.g. 1 / the number of k points), to the (L)DOS.  This
+   is meant to be called from a run, via the accumulate-ldos band
+   function (a thunk, called once per k point). */
+void accumulate_ldos_kpoint(number weight)
+{
+     if (!ldos_nbins) {
+	  mpi_one_fprintf(stderr,
+			  "init-ldos must be called before accumulate-ldos!\n");
+	  return;
+     }
+     if (!mdata || !kpoint_index) {
+	  mpi_one_fprintf(stderr, "solve-kpoint must be called before "
+			  "accumulate-ldos!\n");
+	  return;
+     }
+     if (!ldos)
+	  alloc_ldos();
+     CHECK(ldos_N == mdata->fft_output_size,
+	   "the grid has changed since the LDOS was initialized");
+     ldos->d = mdata; /* may have been re-created for the same grid */
+
+     maxwell_accumulate_ldos(ldos, H, W[0], freqs.items, Vol, weight);
+}
+
+/* Load bin (or, if bin < 0, the sum of the bins times the bin width,
+   the LDOS integrated over the frequency range) of the LDOS into
+   curfield, as a real scalar field (type 'L'), and return the center
+   frequency of the bin. */
+real get_ldos(int bin)
+{
+     int i, j, N;
+     real *f = (real *) mdata->fft_data;
+     real df = (ldos_fmax - ldos_fmin) / ldos_nbins;
+
+     CHECK(ldos && ldos->ldos && bin < ldos_nbins, "no LDOS to get");
+     N = ldos_N;
+     if (bin >= 0)
+	  memcpy(f, ldos->ldos + bin * N, sizeof(real) * N);
+     else
+	  for (i = 0; i < N; ++i) {
+	       real s = 0;
+	       for (j = 0; j < ldos_nbins; ++j)
+		    s += ldos->ldos[j * N + i];
+	       f[i] = s * df;
+	  }
+     curfield = (scalar_complex *) f;
+     curfield_type = 'L';
+     curfield_band = 0;
+     return ldos_fmin + (bin + 0.5) * df;
+}
+
+int ldos_num_bins(void)
+{
+     return ldos && ldos->ldos ? ldos_nbins : 0;
+}
+
+/* Print the DOS and projected DOS, in lines of the form
+
+       dos:, frequency, DOS, projected DOS
+
+   (suitable for grepping), and output the LDOS, if any, to a file
+   with the given prefix (see output_field_to_file). */
+void output_ldos_to_file(string filename_prefix)
+{
+     int j;
+     real df;
+
+     if (!ldos) {
+	  mpi_one_fprintf(stderr, "No LDOS has been accumulated.\n");
+	  return;
+     }
+     df = (ldos_fmax - ldos_fmin) / ldos_nbins;
+     mpi_one_printf("dos:, frequency, DOS, projected DOS\n");
+     for (j = 0; j < ldos_nbins; ++j)
+	  mpi_one_printf("dos:, %g, %g, %g\n",
+			 ldos_fmin + (j + 0.5) * df,
+			 ldos->dos[j], ldos->pdos[j]);
+
+     if (ldos->ldos && mdata) {
+	  get_ldos(-1);
+	  output_field_to_file(-1, filename_prefix);
+     }
+}
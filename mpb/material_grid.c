@@ -401,7 +401,7 @@ void material_grids_addgradient(double *v,
      }
      compute_field_squared();
      Esqr = (real *) curfield;
-     scalegrad *= Vol / H.N;
+     scalegrad *= Vol / mdata->N;
 
      n1 = mdata->nx; n2 = mdata->ny; n3 = mdata->nz;
      n_other = mdata->other_dims;
@@ -811,7 +811,7 @@ static double match_eps_func(int n, const double *u, double *grad, void *data)
      int eps_nx = d->eps_nx, eps_ny = d->eps_ny, eps_nz = d->eps_nz;
      material_grid *grids = d->grids;
      int ngrids = d->ngrids;
-     double scaleby = 1.0 / H.N, val = 0;
+     double scaleby = 1.0 / mdata->N, val = 0;
 
      int i, j, k, n1, n2, n3, n_other, n_last, rank, last_dim;
 #ifdef HAVE_MPI
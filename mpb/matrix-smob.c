@@ -25,6 +25,8 @@
 #include <blasglue.h>
 #include <matrices.h>
 #include <matrixio.h>
+#include <mpiglue.h>
+#include <mpi_utils.h>
 
 #include "matrix-smob.h"
 
@@ -382,4 +384,95 @@ void load_eigenvectors(char *filename)
      curfield_reset();
 }
 
+/* Set the bands b_start ... b_start+num-1 of H, for a supercell whose
+   lattice vectors are integer multiples N of those of a primitive
+   cell, from the first num bands mo of the primitive cell (on the grid
+   prim_grid, with no planewave cutoff) at the k point (k + shift) / N,
+   in the basis of the reciprocal lattice vectors, where k is the
+   current k point of the supercell and shift is an integer vector.
+   Such a primitive-cell band folds onto k in the supercell: its
+   planewave G is the supercell planewave N*G - shift, with the same
+   k+G and hence the same transverse basis, and the other coefficients
+   are zero.  Bands folded from different shifts are orthogonal. */
+void fold_eigenvectors(SCM mo, integer num, vector3 prim_grid,
+		       vector3 shift, integer b_start)
+{
+     evectmatrix *m = assert_evectmatrix_smob(mo);
+     int pn[3], mult[3], sh[3], cp[3], n[3], c[3];
+     int x, y, z, ij = 0, i, b, d, size;
+     scalar *data, *local;
+
+     CHECK(mdata, "init-params must be called before fold-eigenvectors");
+#ifndef SCALAR_COMPLEX
+     CHECK(0, "fold-eigenvectors requires mpb without inversion symmetry");
+#endif
+     pn[0] = prim_grid.x; pn[1] = prim_grid.y; pn[2] = prim_grid.z;
+     sh[0] = shift.x; sh[1] = shift.y; sh[2] = shift.z;
+     n[0] = mdata->nx; n[1] = mdata->ny; n[2] = mdata->nz;
+     for (d = 0; d < 3; ++d) {
+	  CHECK(pn[d] > 0 && n[d] % pn[d] == 0,
+		"supercell grid is not a multiple of the primitive grid");
+	  mult[d] = n[d] / pn[d];
+	  cp[d] = MAX2(1, pn[d] / 2);
+	  c[d] = MAX2(1, n[d] / 2);
+     }
+     CHECK(m->N == pn[0] * pn[1] * pn[2] && m->c == H.c
+	   && EVECTMATRIX_CONTIGUOUS(*m),
+	   "eigenvectors do not match the primitive grid in fold-eigenvectors");
+     CHECK(num >= 0 && num <= m->p && b_start >= 1
+	   && b_start - 1 + num <= H.p,
+	   "invalid band range in fold-eigenvectors");
+
+     /* the primitive-cell eigenvectors are small, so gather all of them
+	on every process */
+     size = m->N * m->c * m->p;
+     CHK_MALLOC(data, scalar, size);
+     CHK_MALLOC(local, scalar, size);
+     for (i = 0; i < size; ++i)
+	  ASSIGN_ZERO(local[i]);
+     for (i = 0; i < m->localN * m->c * m->p; ++i)
+	  local[m->Nstart * m->c * m->p + i] = m->data[i];
+     mpi_allreduce(local, data, size * SCALAR_NUMVALS, real,
+		   SCALAR_MPI_TYPE, MPI_SUM, mpb_comm);
+     free(local);
+
+     for (i = 0; i < H.n; ++i)
+	  for (b = 0; b < num; ++b)
+	       ASSIGN_ZERO(H.data[i * H.ld + b_start - 1 + b]);
+
+     for (x = mdata->local_x_start;
+	  x < mdata->local_x_start + mdata->local_nx; ++x)
+	  for (y = 0; y < n[1]; ++y)
+	       for (z = 0; z < n[2]; ++z, ++ij) {
+		    int ipw = MAXWELL_PLANEWAVE(mdata, ij), g[3], ip, ic;
+
+		    if (ipw < 0)
+			 continue;
+		    g[0] = (x >= c[0]) ? x - n[0] : x;
+		    g[1] = (y >= c[1]) ? y - n[1] : y;
+		    g[2] = (z >= c[2]) ? z - n[2] : z;
+		    for (d = 0; d < 3; ++d) {
+			 int s = g[d] + sh[d];
+			 if (s % mult[d] != 0)
+			      break;
+			 g[d] = s / mult[d];
+			 if (g[d] < cp[d] - pn[d] || g[d] >= cp[d])
+			      break; /* not in the primitive grid */
+			 if (g[d] < 0)
+			      g[d] += pn[d];
+		    }
+		    if (d < 3)
+			 continue;
+		    ip = (g[0] * pn[1] + g[1]) * pn[2] + g[2];
+		    for (ic = 0; ic < H.c; ++ic)
+			 for (b = 0; b < num; ++b)
+			      H.data[(ipw * H.c + ic) * H.ld + b_start - 1 + b]
+				   = data[(ip * m->c + ic) * m->p + b];
+	       }
+
+     free(data);
+     curfield_reset();
+     scm_remember_upto_here_1(mo);
+}
+
 /*************************************************************************/
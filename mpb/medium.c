@@ -127,6 +127,7 @@ void reset_epsilon(void)
 			   &d.epsilon_file_func, &d.epsilon_file_func_data);
      get_epsilon_file_func(mu_input_file,
                            &d.mu_file_func, &d.mu_file_func_data);
+     mdata->mesh_tolerance = mesh_tolerance;
      mpi_one_printf("Initializing epsilon function...\n");
      set_maxwell_dielectric(mdata, mesh, R, G, 
 			    epsilon_func, mean_epsilon_func, &d);
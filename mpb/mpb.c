@@ -56,6 +56,7 @@
 
 /* global verbosity configuration */
 #include "verbosity.h"
+#include "large_malloc.h"
 
 #if defined(DEBUG) && defined(HAVE_FEENABLEEXCEPT)
 #  ifndef _GNU_SOURCE
@@ -240,7 +241,8 @@ int nwork_alloc = 0;
 
 maxwell_data *mdata = NULL;
 maxwell_target_data *mtdata = NULL;
-evectmatrix H, W[MAX_NWORK], Hblock, muinvH;
+maxwell_irrep_data *irdata = NULL;
+evectmatrix H, W[MAX_NWORK], muinvH;
 
 vector3 cur_kvector;
 scalar_complex *curfield = NULL;
@@ -318,6 +320,19 @@ void set_kpoint_index(integer i)
      kpoint_index = i;
 }
 
+/* Guile-callable function for setting the tag of the frequency lines
+   printed by solve_kpoint ("freqs" by default), so that internal
+   solves (e.g. in fold-primitive-bands) can be told apart from the
+   ordinary output. */
+
+static char freqs_tag[64] = "freqs";
+
+void set_freqs_tag(char *tag)
+{
+     strncpy(freqs_tag, tag, sizeof(freqs_tag) - 1);
+     freqs_tag[sizeof(freqs_tag) - 1] = 0;
+}
+
 /**************************************************************************/
 
 /* return a string describing the current parity, used for frequency
@@ -384,7 +399,7 @@ void set_parity(integer p)
    fields are allocated and initialized to random numbers. */
 void init_params(integer p, boolean reset_fields)
 {
-     int i, local_N, N_start, alloc_N;
+     int i, N, local_N, N_start, alloc_N;
      int nx, ny, nz;
      int have_old_fields = 0;
      int block_size;
@@ -441,19 +456,19 @@ void init_params(integer p, boolean reset_fields)
 
      if (mdata) {  /* need to clean up from previous init_params call */
 	  if (nx == mdata->nx && ny == mdata->ny && nz == mdata->nz &&
-	      block_size == Hblock.alloc_p && num_bands == H.p &&
+	      planewave_cutoff == mdata->planewave_cutoff &&
+	      block_size == W[0].alloc_p && num_bands == H.p &&
 	      eigensolver_nwork + (mdata->mu_inv!=NULL) == nwork_alloc)
 	       have_old_fields = 1; /* don't need to reallocate */
 	  else {
 	       destroy_evectmatrix(H);
 	       for (i = 0; i < nwork_alloc; ++i)
 		    destroy_evectmatrix(W[i]);
-	       if (Hblock.data != H.data)
-		    destroy_evectmatrix(Hblock);
                if (muinvH.data != H.data)
                    destroy_evectmatrix(muinvH);
 	  }
 	  destroy_maxwell_target_data(mtdata); mtdata = NULL;
+	  destroy_maxwell_irrep_data(irdata); irdata = NULL;
 	  destroy_maxwell_data(mdata); mdata = NULL;
 	  curfield_reset();
      }
@@ -468,10 +483,21 @@ void init_params(integer p, boolean reset_fields)
 	  srand(314159 * (rank + 1));
      }
 
+     mpb_huge_pages = huge_pages;
+
      mpi_one_printf("Creating Maxwell data...\n");
      mdata = create_maxwell_data(nx, ny, nz, &local_N, &N_start, &alloc_N,
                                  block_size, NUM_FFT_BANDS);
      CHECK(mdata, "NULL mdata");
+     maxwell_set_planewave_cutoff(mdata, planewave_cutoff,
+				  &N, &local_N, &N_start, &alloc_N);
+     if (mdata->grid_planewave)
+	  mpi_one_printf("Using %d of %d planewaves (cutoff %g).\n",
+			 N, nx * ny * nz, planewave_cutoff);
+     if (band_groups > 1)
+	  mpi_one_printf("Dividing the bands among %d groups of processes.\n",
+			 band_groups);
+     maxwell_set_band_groups(mdata, band_groups);
 
      if (target_freq != 0.0)
 	  mtdata = create_maxwell_target_data(mdata, target_freq);
@@ -480,26 +506,55 @@ void init_params(integer p, boolean reset_fields)
 
      init_epsilon();
 
+     if (irrep_projection.num_items > 0) {
+	  int iop, nops = irrep_projection.num_items;
+	  real *Wops, *wops;
+	  scalar_complex *chi;
+
+	  mpi_one_printf("Projecting onto irrep given by %d symmetry "
+			 "operations.\n", nops);
+	  CHK_MALLOC(Wops, real, 9 * nops);
+	  CHK_MALLOC(wops, real, 3 * nops);
+	  CHK_MALLOC(chi, scalar_complex, nops);
+	  for (iop = 0; iop < nops; ++iop) {
+	       real Wcols[3][3];
+	       int a, b;
+	       /* matrix3x3_to_arr gives the columns of the matrix: */
+	       matrix3x3_to_arr(Wcols, irrep_projection.items[iop].rotation);
+	       for (a = 0; a < 3; ++a)
+		    for (b = 0; b < 3; ++b)
+			 Wops[9*iop + 3*a + b] = Wcols[b][a];
+	       vector3_to_arr(wops + 3*iop,
+			      irrep_projection.items[iop].translation);
+	       chi[iop] = cnumber2cscalar(irrep_projection.items[iop].character);
+	  }
+	  irdata = create_maxwell_irrep_data(mdata, R, nops, Wops, wops, chi);
+	  free(chi);
+	  free(wops);
+	  free(Wops);
+     }
+
      if (!have_old_fields) {
 	  mpi_one_printf("Allocating fields...\n");
-	  H = create_evectmatrix(nx * ny * nz, 2, num_bands,
+	  H = create_evectmatrix(N, 2, num_bands,
 				 local_N, N_start, alloc_N);
 	  nwork_alloc = eigensolver_nwork + (mdata->mu_inv!=NULL);
 	  for (i = 0; i < nwork_alloc; ++i)
-	       W[i] = create_evectmatrix(nx * ny * nz, 2, block_size,
+	       W[i] = create_evectmatrix(N, 2, block_size,
 					 local_N, N_start, alloc_N);
-	  if (block_size < num_bands)
-	       Hblock = create_evectmatrix(nx * ny * nz, 2, block_size,
-					   local_N, N_start, alloc_N);
-	  else
-	       Hblock = H;
           if (using_mup() && block_size < num_bands) {
-              muinvH = create_evectmatrix(nx * ny * nz, 2, num_bands,
+              muinvH = create_evectmatrix(N, 2, num_bands,
                                           local_N, N_start, alloc_N);
           }
           else {
               muinvH = H;
           }
+	  if (huge_pages != LARGE_MALLOC_NO_HUGE_PAGES
+#ifdef USE_OPENMP
+	      || omp_get_max_threads() > 1
+#endif
+	       )
+	       large_malloc_report();
      }
 
      mpi_one_printf("%d k-points:\n", k_points.num_items);
@@ -528,6 +583,11 @@ void init_params(integer p, boolean reset_fields)
 	  CHECK(!ierr, "invalid dielectric function\n");
      }
 
+     if (check_inversion_symmetryp &&
+	 maxwell_dielectric_inversion_symmetric(mdata, 1e-8))
+	  mpi_one_printf("The structure has inversion symmetry, so mpbi "
+			 "could solve it in about half the time and memory.\n");
+
      evectmatrix_flops = eigensolver_flops; /* reset, if changed */
 }
 
@@ -551,8 +611,20 @@ typedef struct {
      scalar *S;  /* a matrix for storing the dot products; should have
 		    at least p * X.p elements (see below for X) */
      scalar *S2; /* a scratch matrix the same size as S */
+     scalar *relax_X; /* if non-NULL (relax-deflation?), the data of the
+			 block being solved for: the eigensolver's
+			 re-projections of that block after each line
+			 minimization, which only keep roundoff from
+			 accumulating, are then done only every
+			 RELAXED_DEFLATION_INTERVAL times (the search
+			 directions are always projected) */
+     int relax_count; /* number of those re-projections so far */
+     int relax_searched; /* whether a search direction has been projected
+			    since the last call for relax_X */
 } deflation_data;
 
+#define RELAXED_DEFLATION_INTERVAL 10
+
 static void deflation_constraint(evectmatrix X, void *data)
 {
      deflation_data *d = (deflation_data *) data;
@@ -560,6 +632,20 @@ static void deflation_constraint(evectmatrix X, void *data)
      CHECK(X.n == d->BY.n && d->BY.p >= d->p && d->Y.p >= d->p,
            "invalid dimensions");
 
+     if (d->relax_X) {
+	  /* The eigensolver projects each search direction, and then
+	     re-projects the block after the line minimization along it.
+	     Any other projection of the block (the initial one, or one
+	     after the eigensolver has re-randomized it) is not relaxed. */
+	  if (X.data != d->relax_X)
+	       d->relax_searched = 1;
+	  else if (d->relax_searched) {
+	       d->relax_searched = 0;
+	       if (++d->relax_count % RELAXED_DEFLATION_INTERVAL != 0)
+		    return;
+	  }
+     }
+
      /* compute (1 - Y (BY)t) X = (1 - Y Yt B) X
           = projection of X so that Yt B X = 0 */
 
@@ -569,14 +655,14 @@ static void deflation_constraint(evectmatrix X, void *data)
 
      /* compute S = Xt BY (i.e. all the dot products): */
      blasglue_gemm('C', 'N', X.p, d->p, X.n,
-		   1.0, X.data, X.p, d->BY.data, d->BY.p, 0.0, d->S2, d->p);
+		   1.0, X.data, X.ld, d->BY.data, d->BY.ld, 0.0, d->S2, d->p);
      mpi_allreduce(d->S2, d->S, d->p * X.p * SCALAR_NUMVALS,
 		   real, SCALAR_MPI_TYPE, MPI_SUM, mpb_comm);
 
      /* compute X = X - Y*St = (1 - BY Yt B) X */
      blasglue_gemm('N', 'C', X.n, X.p, d->p,
-		   -1.0, d->Y.data, d->Y.p, d->S, d->p,
-		   1.0, X.data, X.p);
+		   -1.0, d->Y.data, d->Y.ld, d->S, d->p,
+		   1.0, X.data, X.ld);
 }
 
 /**************************************************************************/
@@ -585,7 +671,7 @@ static void deflation_constraint(evectmatrix X, void *data)
    Must only be called after init_params! */
 void solve_kpoint(vector3 kvector)
 {
-     int i, total_iters = 0, ib, ib0;
+     int i, total_iters = 0, ib, ib0, block_size = W[0].alloc_p;
      real *eigvals;
      real k[3];
      int flags;
@@ -616,8 +702,8 @@ void solve_kpoint(vector3 kvector)
      /* if this is the first k point, print out a header line for
 	for the frequency grep data: */
      if (!kpoint_index && mpi_is_master()) {
-	  printf("%sfreqs:, k index, k1, k2, k3, kmag/2pi",
-		 parity_string(mdata));
+	  printf("%s%s:, k index, k1, k2, k3, kmag/2pi",
+		 parity_string(mdata), freqs_tag);
 	  for (i = 0; i < num_bands; ++i)
 	       printf(", %s%sband %d",
 		      parity_string(mdata),
@@ -632,6 +718,9 @@ void solve_kpoint(vector3 kvector)
      update_maxwell_data_k(mdata, k, G[0], G[1], G[2]);
      CHECK(mdata->parity == prev_parity,
 	   "k vector is incompatible with specified parity");
+     if (irdata)
+	  maxwell_irrep_set_k(irdata);
+     mdata->precond_eps_tensor = local_epsilon_preconditionerp;
 
      CHK_MALLOC(eigvals, real, num_bands);
 
@@ -640,29 +729,25 @@ void solve_kpoint(vector3 kvector)
 	  flags |= EIGS_VERBOSE;
 
      /* constant (zero frequency) bands at k=0 are handled specially,
-        so remove them from the solutions for the eigensolver: */
-     if (mdata->zero_k && !mtdata) {
-	  int in, ip;
+        so remove them from the solutions for the eigensolver.  (They
+        are omitted entirely when projecting onto an irrep, since they
+        need not belong to it.) */
+     if (mdata->zero_k && !mtdata && !irdata)
 	  ib0 = maxwell_zero_k_num_const_bands(H, mdata);
-	  for (in = 0; in < H.n; ++in)
-	       for (ip = 0; ip < H.p - ib0; ++ip)
-		    H.data[in * H.p + ip] = H.data[in * H.p + ip + ib0];
-	  evectmatrix_resize(&H, H.p - ib0, 1);
-     }
      else
 	  ib0 = 0; /* solve for all bands */
 
      /* Set up deflation data: */
-     if (muinvH.data != Hblock.data) {
-          deflation.Y = H;
-          deflation.BY = muinvH.data != H.data ? muinvH : H;
+     deflation.relax_X = NULL;
+     if (num_bands - ib0 > block_size) {
 	  deflation.p = 0;
-	  CHK_MALLOC(deflation.S, scalar, H.p * Hblock.p);
-	  CHK_MALLOC(deflation.S2, scalar, H.p * Hblock.p);
+	  CHK_MALLOC(deflation.S, scalar, num_bands * block_size);
+	  CHK_MALLOC(deflation.S2, scalar, num_bands * block_size);
      }
 
-     for (ib = ib0; ib < num_bands; ib += Hblock.alloc_p) {
+     for (ib = ib0; ib < num_bands; ib += block_size) {
 	  evectconstraint_chain *constraints;
+	  evectmatrix Hblock;
 	  int num_iters;
 
 	  /* don't solve for too many bands if the block size doesn't divide
@@ -671,9 +756,11 @@ void solve_kpoint(vector3 kvector)
 	       maxwell_set_num_bands(mdata, num_bands - ib);
 	       for (i = 0; i < nwork_alloc; ++i)
 		    evectmatrix_resize(&W[i], num_bands - ib, 0);
-	       evectmatrix_resize(&Hblock, num_bands - ib, 0);
 	  }
 
+	  /* the eigensolver works in place on the current block of H: */
+	  Hblock = evectmatrix_view(H, ib, mdata->num_bands);
+
 	  mpi_one_printf("Solving for bands %d to %d...\n",
 			 ib + 1, ib + Hblock.p);
 
@@ -687,23 +774,33 @@ void solve_kpoint(vector3 kvector)
 						  maxwell_zero_k_constraint,
 						  (void *) mdata);
 
-	  if (Hblock.data != H.data) {  /* initialize fields of block from H */
-	       int in, ip;
-	       for (in = 0; in < Hblock.n; ++in)
-		    for (ip = 0; ip < Hblock.p; ++ip)
-			 Hblock.data[in * Hblock.p + ip] =
-			      H.data[in * H.p + ip + (ib-ib0)];
+	  if (irdata)
+	       constraints = evect_add_constraint(constraints,
+						  maxwell_irrep_constraint,
+						  (void *) irdata);
+
+	  /* deflate against the bands already solved for, in place in H: */
+	  if (ib > ib0) {
 	       deflation.p = ib-ib0;
-	       if (deflation.p > 0) {
-                    if (deflation.BY.data != H.data) {
-                        evectmatrix_resize(&deflation.BY, deflation.p, 0);
-                        maxwell_muinv_operator(H, deflation.BY, (void *) mdata,
-                                               1, deflation.BY);
-                    }
-		    constraints = evect_add_constraint(constraints,
-						       deflation_constraint,
-						       &deflation);
-               }
+	       deflation.Y = evectmatrix_view(H, ib0, deflation.p);
+	       if (muinvH.data != H.data) {
+		    deflation.BY = muinvH;
+		    evectmatrix_resize(&deflation.BY, deflation.p, 0);
+		    maxwell_muinv_operator(deflation.Y, deflation.BY,
+					   (void *) mdata, 1, deflation.BY);
+	       }
+	       else
+		    deflation.BY = deflation.Y;
+	       constraints = evect_add_constraint(constraints,
+						  deflation_constraint,
+						  &deflation);
+	       /* for well-separated spectra, the periodic re-projection
+		  of the block being solved for is cheaper and sufficient */
+	       if (relax_deflationp) {
+		    deflation.relax_X = Hblock.data;
+		    deflation.relax_count = 0;
+		    deflation.relax_searched = 0;
+	       }
 	  }
 
 	  if (mtdata) {  /* solving for bands near a target frequency */
@@ -712,6 +809,7 @@ void solve_kpoint(vector3 kvector)
 		    eigensolver_davidson(
 			 Hblock, eigvals + ib,
 			 maxwell_target_operator, (void *) mtdata,
+			 NULL, NULL,
 			 simple_preconditionerp ?
 			 maxwell_target_preconditioner :
 			 maxwell_target_preconditioner2,
@@ -740,10 +838,11 @@ void solve_kpoint(vector3 kvector)
 	  }
 	  else {
                if (eigensolver_davidsonp) {
-                    CHECK(mdata->mu_inv==NULL, "Davidson doesn't handle mu");
 		    eigensolver_davidson(
 			 Hblock, eigvals + ib,
 			 maxwell_operator, (void *) mdata,
+			 mdata->mu_inv ? maxwell_muinv_operator : NULL,
+			 (void *) mdata,
 			 simple_preconditionerp ?
 			 maxwell_preconditioner :
 			 maxwell_preconditioner2,
@@ -766,12 +865,11 @@ void solve_kpoint(vector3 kvector)
 				W, nwork_alloc, tolerance, &num_iters, flags);
 	  }
 
-	  if (Hblock.data != H.data) {  /* save solutions of current block */
-	       int in, ip;
-	       for (in = 0; in < Hblock.n; ++in)
-		    for (ip = 0; ip < Hblock.p; ++ip)
-			 H.data[in * H.p + ip + (ib-ib0)] =
-			      Hblock.data[in * Hblock.p + ip];
+	  /* with relax-deflation?, Hblock may have drifted slightly since
+	     it was last projected: */
+	  if (deflation.relax_X) {
+	       deflation.relax_X = NULL;
+	       deflation_constraint(Hblock, &deflation);
 	  }
 
 	  evect_destroy_constraints(constraints);
@@ -781,30 +879,24 @@ void solve_kpoint(vector3 kvector)
 	  total_iters += num_iters * Hblock.p;
      }
 
-     if (num_bands - ib0 > Hblock.alloc_p)
+     if (num_bands - ib0 > block_size)
 	  mpi_one_printf("Finished k-point with %g mean iterations/band.\n",
 			 total_iters * 1.0 / num_bands);
 
      /* Manually put in constant (zero-frequency) solutions for k=0: */
-     if (mdata->zero_k && !mtdata) {
-	  int in, ip;
-	  evectmatrix_resize(&H, H.alloc_p, 1);
-	  for (in = 0; in < H.n; ++in)
-	       for (ip = H.p - ib0 - 1; ip >= 0; --ip)
-		    H.data[in * H.p + ip + ib0] = H.data[in * H.p + ip];
+     if (mdata->zero_k && !mtdata && !irdata) {
 	  maxwell_zero_k_set_const_bands(H, mdata);
 	  for (ib = 0; ib < ib0; ++ib)
 	       eigvals[ib] = 0;
      }
 
      /* Reset scratch matrix sizes: */
-     evectmatrix_resize(&Hblock, Hblock.alloc_p, 0);
      for (i = 0; i < nwork_alloc; ++i)
 	  evectmatrix_resize(&W[i], W[i].alloc_p, 0);
-     maxwell_set_num_bands(mdata, Hblock.alloc_p);
+     maxwell_set_num_bands(mdata, block_size);
 
      /* Destroy deflation data: */
-     if (H.data != Hblock.data) {
+     if (num_bands - ib0 > block_size) {
 	  free(deflation.S2);
 	  free(deflation.S);
      }
@@ -825,8 +917,8 @@ void solve_kpoint(vector3 kvector)
 
      set_kpoint_index(kpoint_index + 1);
 
-     mpi_one_printf("%sfreqs:, %d, %g, %g, %g, %g",
-		    parity,
+     mpi_one_printf("%s%s:, %d, %g, %g, %g, %g",
+		    parity, freqs_tag,
 		    kpoint_index, (double)k[0], (double)k[1], (double)k[2],
 		    vector3_norm(matrix3x3_vector3_mult(Gm, kvector)));
      for (i = 0; i < num_bands; ++i) {
@@ -900,15 +992,23 @@ number_list compute_group_velocity_component(vector3 d)
      /* ...we have to do this in blocks of eigensolver_block_size since
 	the work matrix W[0] may not have enough space to do it all at once. */
 
-     for (ib = 0; ib < num_bands; ib += Hblock.alloc_p) {
+     for (ib = 0; ib < num_bands; ib += W[0].alloc_p) {
+	  evectmatrix Hblock;
+
 	  if (ib + mdata->num_bands > num_bands) {
 	       maxwell_set_num_bands(mdata, num_bands - ib);
 	       evectmatrix_resize(&W[0], num_bands - ib, 0);
-	       evectmatrix_resize(&Hblock, num_bands - ib, 0);
 	  }
-          maxwell_compute_H_from_B(mdata, H, Hblock,
-                                   (scalar_complex *) mdata->fft_data,
-                                   ib, 0, Hblock.p);
+	  if (mdata->mu_inv) { /* Hblock = 1/mu * B, using W[1] as storage */
+	       CHECK(nwork_alloc >= 2, "not enough workspace");
+	       Hblock = W[1];
+	       evectmatrix_resize(&Hblock, W[0].p, 0);
+	       maxwell_compute_H_from_B(mdata, H, Hblock,
+					(scalar_complex *) mdata->fft_data,
+					ib, 0, Hblock.p);
+	  }
+	  else
+	       Hblock = evectmatrix_view(H, ib, W[0].p);
 	  maxwell_ucross_op(Hblock, W[0], mdata, u);
 	  evectmatrix_XtY_diag_real(Hblock, W[0], gv_scratch,
 				    gv_scratch + group_v.num_items);
@@ -922,9 +1022,8 @@ number_list compute_group_velocity_component(vector3 d)
      free(gv_scratch);
 
      /* Reset scratch matrix sizes: */
-     evectmatrix_resize(&Hblock, Hblock.alloc_p, 0);
      evectmatrix_resize(&W[0], W[0].alloc_p, 0);
-     maxwell_set_num_bands(mdata, Hblock.alloc_p);
+     maxwell_set_num_bands(mdata, W[0].alloc_p);
 
      /* The group velocity is given by:
 
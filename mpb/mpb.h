@@ -53,7 +53,7 @@ extern int nwork_alloc;
 
 extern maxwell_data *mdata;
 extern maxwell_target_data *mtdata;
-extern evectmatrix H, W[MAX_NWORK], Hblock;
+extern evectmatrix H, W[MAX_NWORK];
 
 extern vector3 cur_kvector;
 extern scalar_complex *curfield;
@@ -76,6 +76,10 @@ void get_efield(integer which_band);
 real mean_medium_from_matrix(const symmetric_matrix *eps_inv);
 void get_bloch_field_point_(scalar_complex *field, vector3 p);
 
+/* in ldos.c */
+extern real get_ldos(int bin);
+extern int ldos_num_bins(void);
+
 /**************************************************************************/
 
 extern void vector3_to_arr(real arr[3], vector3 v);
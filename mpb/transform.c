@@ -173,8 +173,8 @@ cnumber transformed_overlap(matrix3x3 W, vector3 w)
         integral.im += CSCALAR_MULT_IM(integrand, phase);
     }}}
 
-    integral.re *= Vol / H.N;
-    integral.im *= Vol / H.N;
+    integral.re *= Vol / mdata->N;
+    integral.im *= Vol / mdata->N;
 
     mpi_allreduce(&integral, &integral_sum, 2, number,
                   MPI_DOUBLE, MPI_SUM, mpb_comm);
@@ -91,6 +91,8 @@ extern scalar F(dot,DOT) (int *, scalar *, int *, scalar *, int *);
 extern void F(gemm,GEMM) (char *, char *, int *, int *, int *,
 			  scalar *, scalar *, int *, scalar *, int *,
 			  scalar *, scalar *, int *);
+extern void F(trsm,TRSM) (char *, char *, char *, char *, int *, int *,
+			  scalar *, scalar *, int *, scalar *, int *);
 extern void F(herk,HERK) (char *, char *, int *, int *,
 			  real *, scalar *, int *,
 			  real *, scalar *, int *);
@@ -212,6 +214,28 @@ void blasglue_gemm(char transa, char transb, int m, int n, int k,
 		   &alpha, B, &fdB, A, &fdA, &beta, C, &fdC);
 }
 
+/* Solve op(A) X = a B (side == 'L') or X op(A) = a B (side == 'R') for
+   the m x n matrix X, overwriting B, where A is triangular. */
+void blasglue_trsm(char side, char uplo, char transa, char diag,
+		   int m, int n, real a, scalar *A, int fdA,
+		   scalar *B, int fdB)
+{
+     scalar alpha;
+
+     if (m*n == 0)
+	  return;
+
+     ASSIGN_REAL(alpha, a);
+
+     /* the transposed (column-major) equation has the other side, and
+	the other triangle of A, with the same op */
+     side = side == 'L' ? 'R' : 'L';
+     uplo = uplo == 'U' ? 'L' : 'U';
+
+     F(trsm,TRSM) (&side, &uplo, &transa, &diag, &n, &m,
+		   &alpha, A, &fdA, B, &fdB);
+}
+
 void blasglue_herk(char uplo, char trans, int n, int k,
 		   real a, scalar *A, int fdA,
 		   real b, scalar *C, int fdC)
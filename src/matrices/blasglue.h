@@ -29,6 +29,9 @@ extern scalar blasglue_dotc(int n, scalar *x, int incx, scalar *y, int incy);
 void blasglue_gemm(char transa, char transb, int m, int n, int k,
                    real a, scalar *A, int fdA, scalar *B, int fdB,
                    real b, scalar *C, int fdC);
+extern void blasglue_trsm(char side, char uplo, char transa, char diag,
+			  int m, int n, real a, scalar *A, int fdA,
+			  scalar *B, int fdB);
 extern void blasglue_herk(char uplo, char trans, int n, int k,
 			  real a, scalar *A, int fdA,
 			  real b, scalar *C, int fdC);
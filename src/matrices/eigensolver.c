@@ -36,6 +36,9 @@ extern void eigensolver_get_eigenvals_aux(evectmatrix Y, real *eigenvals,
                                           evectmatrix Work1, evectmatrix Work2,
                                           sqmatrix U, sqmatrix Usqrt,
                                           sqmatrix Uwork);
+extern int eigensolver_orthonormalize_cholqr2(evectmatrix Y, evectmatrix BY,
+					      short B,
+					      sqmatrix R, sqmatrix S);
 
 #define STRINGIZEx(x) #x /* a hack so that we can stringize macro values */
 #define STRINGIZE(x) STRINGIZEx(x)
@@ -218,7 +221,8 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
      mpiglue_clock_t prev_feedback_time;
      real time_AZ, time_KZ=0, time_ZtZ, time_ZtW, time_ZS, time_linmin=0;
      real linmin_improvement = 0;
-     sqmatrix YtAYU, DtAD, symYtAD, YtBY, U, DtBD, symYtBD, S1, S2, S3;
+     sqmatrix YtAYU, UYtAYU, DtAD, symYtAD, YtBY, U, DtBD, symYtBD;
+     sqmatrix S1, S2, S3;
      trace_func_data tfd;
 
      prev_feedback_time = MPIGLUE_CLOCK;
@@ -228,6 +232,9 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
 #endif
 
      CHECK(nWork >= 2, "not enough workspace");
+
+     if (flags & EIGS_DISTRIBUTE_PRODUCTS)
+	  sqmatrix_distribute_products(Y.p);
      G = Work[0];
      X = Work[1];
 
@@ -262,6 +269,7 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
           prev_G = G;
 
      YtAYU = create_sqmatrix(Y.p);  /* holds Yt A Y */
+     UYtAYU = create_sqmatrix(Y.p);  /* holds U Yt A Y U */
      DtAD = create_sqmatrix(Y.p);  /* holds Dt A D */
      symYtAD = create_sqmatrix(Y.p);  /* holds (Yt A D + Dt A Y) / 2 */
      YtBY = create_sqmatrix(Y.p);  /* holds Yt B Y */
@@ -284,18 +292,19 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
  restartY:
 
      if (flags & EIGS_ORTHONORMALIZE_FIRST_STEP) {
-          if (B) {
+          if (B)
               B(Y, BY, Bdata, 1, G); /* B*Y; G is scratch */
-              evectmatrix_XtY(U, Y, BY, S2);
-          }
-          else {
-              evectmatrix_XtX(U, Y, S2);
-          }
-	  sqmatrix_assert_hermitian(U);
-	  CHECK(sqmatrix_invert(U, 1, S2), "non-independent initial Y");
-	  sqmatrix_sqrt(S1, U, S2); /* S1 = 1/sqrt(Yt*Y) */
-	  evectmatrix_XeYS(G, Y, S1, 1); /* G = orthonormalize Y */
-	  evectmatrix_copy(Y, G);
+	  if (!eigensolver_orthonormalize_cholqr2(Y, BY, B != NULL, S1, S2)) {
+	       if (B)
+		    evectmatrix_XtY(U, Y, BY, S2);
+	       else
+		    evectmatrix_XtX(U, Y, S2);
+	       sqmatrix_assert_hermitian(U);
+	       CHECK(sqmatrix_invert(U, 1, S2), "non-independent initial Y");
+	       sqmatrix_sqrt(S1, U, S2); /* S1 = 1/sqrt(Yt*Y) */
+	       evectmatrix_XeYS(G, Y, S1, 1); /* G = orthonormalize Y */
+	       evectmatrix_copy(Y, G);
+	  }
      }
 
      for (i = 0; i < Y.p; ++i)
@@ -323,7 +332,7 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
 	  sqmatrix_assert_hermitian(YtBY);
 
 	  y_norm = sqrt(SCALAR_RE(sqmatrix_trace(YtBY)) / Y.p);
-	  blasglue_rscal(Y.p * Y.n, 1/y_norm, Y.data, 1);
+	  evectmatrix_aXpbY(1/y_norm, Y, 0.0, Y);
 	  if (B) blasglue_rscal(Y.p * Y.n, 1/y_norm, BY.data, 1);
 	  blasglue_rscal(Y.p * Y.p, 1/(y_norm*y_norm), YtBY.data, 1);
 
@@ -337,10 +346,13 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
 	       		mpi_one_printf("    emergency randomization of Y on iter. %d\n",
 			               iteration);
 	       }
-	       for (i = 0; i < Y.p * Y.n; ++i)
-		    ASSIGN_SCALAR(Y.data[i],
-				  rand() * 1.0 / RAND_MAX - 0.5,
-				  rand() * 1.0 / RAND_MAX - 0.5);
+	       for (i = 0; i < Y.n; ++i) {
+		    int j;
+		    for (j = 0; j < Y.p; ++j)
+			 ASSIGN_SCALAR(Y.data[i * Y.ld + j],
+				       rand() * 1.0 / RAND_MAX - 0.5,
+				       rand() * 1.0 / RAND_MAX - 0.5);
+	       }
 	       goto restartY;
 	  }
 
@@ -358,18 +370,30 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
 	       	    if (mpb_verbosity >= 1) {
 		        mpi_one_printf("    re-orthonormalizing Y\n");
 		    }
-		    sqmatrix_sqrt(S1, U, S2); /* S1 = 1/sqrt(Yt*Y) */
-		    evectmatrix_XeYS(G, Y, S1, 1); /* G = orthonormalize Y */
-		    evectmatrix_copy(Y, G);
+		    /* BY = B*Y is still current here, so CholeskyQR2
+		       can update it along with Y: */
+		    if (!eigensolver_orthonormalize_cholqr2(Y, BY, B != NULL, S1, S2)) {
+			 /* Y (and BY) may have been partially
+			    orthonormalized, so U is stale: */
+			 if (B)
+			      evectmatrix_XtY(U, Y, BY, S2);
+			 else
+			      evectmatrix_XtX(U, Y, S2);
+			 CHECK(sqmatrix_invert(U, 1, S2),
+			       "non-independent Y in re-orthogonalization");
+			 sqmatrix_sqrt(S1, U, S2); /* S1 = 1/sqrt(Yt*Y) */
+			 evectmatrix_XeYS(G, Y, S1, 1); /* G = orthonormalize Y */
+			 evectmatrix_copy(Y, G);
+			 if (B)
+			      B(Y, BY, Bdata, 1, G); /* B*Y; G is scratch */
+		    }
 		    prev_traceGtX = 0.0;
-                    if (B) {
-                        B(Y, BY, Bdata, 1, G); /* B*Y; G is scratch */
+                    if (B)
                         evectmatrix_XtY(YtBY, Y, BY, S2);
-                    }
                     else
                         evectmatrix_XtX(YtBY, Y, S2);
 		    y_norm = sqrt(SCALAR_RE(sqmatrix_trace(YtBY)) / Y.p);
-		    blasglue_rscal(Y.p * Y.n, 1/y_norm, Y.data, 1);
+		    evectmatrix_aXpbY(1/y_norm, Y, 0.0, Y);
 		    if (B) blasglue_rscal(Y.p * Y.n, 1/y_norm, BY.data, 1);
 		    blasglue_rscal(Y.p * Y.p, 1/(y_norm*y_norm), YtBY.data, 1);
 		    sqmatrix_copy(U, YtBY);
@@ -423,8 +447,8 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
                break; /* convergence!  hooray! */
 
 	  /* Compute gradient of functional: G = (1 - BY U Yt) A Y U */
-	  sqmatrix_AeBC(S1, U, 0, YtAYU, 0);
-	  evectmatrix_XpaYS(G, -1.0, BY, S1, 1);
+	  sqmatrix_AeBC(UYtAYU, U, 0, YtAYU, 0);
+	  evectmatrix_XpaYS(G, -1.0, BY, UYtAYU, 1);
 
 	  if (L) { /* include Lagrange gradient; note X = LY from above */
 	       evectmatrix_aXpbY(1.0, G, *lag, X);
@@ -668,16 +692,17 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
 	       evectmatrix_XtY(S1, Y, G, S2);
 	       sqmatrix_symmetrize(symYtAD, S1);
 
-	       sqmatrix_AeBC(S1, U, 0, symYtBD, 1);
+	       /* The U Yt A Y U factor (saved from the gradient) lets us
+		  take the traces below without another O(p^3) product: */
 	       dE = 2.0 * (SCALAR_RE(sqmatrix_traceAtB(U, symYtAD)) -
-			   SCALAR_RE(sqmatrix_traceAtB(YtAYU, S1)));
+			   SCALAR_RE(sqmatrix_traceAtB(UYtAYU, symYtBD)));
 
+	       sqmatrix_AeBC(S1, U, 0, symYtBD, 1);
 	       sqmatrix_copy(S2, DtBD);
 	       sqmatrix_ApaBC(S2, -4.0, symYtBD, 0, S1, 0);
 	       sqmatrix_AeBC(S3, symYtAD, 0, S1, 0);
-	       sqmatrix_AeBC(S1, U, 0, S2, 1);
 	       d2E = 2.0 * (SCALAR_RE(sqmatrix_traceAtB(U, DtAD)) -
-			    SCALAR_RE(sqmatrix_traceAtB(YtAYU, S1)) -
+			    SCALAR_RE(sqmatrix_traceAtB(UYtAYU, S2)) -
 			    4.0 * SCALAR_RE(sqmatrix_traceAtB(U, S3)));
 
 	       if (L) {
@@ -819,7 +844,11 @@ void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
      destroy_sqmatrix(YtBY);
      destroy_sqmatrix(symYtAD);
      destroy_sqmatrix(DtAD);
+     destroy_sqmatrix(UYtAYU);
      destroy_sqmatrix(YtAYU);
+
+     if (flags & EIGS_DISTRIBUTE_PRODUCTS)
+	  sqmatrix_distribute_products(0);
 }
 
 void eigensolver(evectmatrix Y, real *eigenvals,
@@ -60,6 +60,7 @@ extern void eigensolver_lagrange(evectmatrix Y, real *eigenvals,
 
 extern void eigensolver_davidson(evectmatrix Y, real *eigenvals,
 				 evectoperator A, void *Adata,
+				 evectoperator B, void *Bdata,
 				 evectpreconditioner K, void *Kdata,
 				 evectconstraint constraint,
 				 void *constraint_data,
@@ -83,6 +84,7 @@ extern void eigensolver_get_eigenvals(evectmatrix Y, real *eigenvals,
 #define EIGS_REORTHOGONALIZE (1<<6)
 #define EIGS_DYNAMIC_RESET_CG (1<<7)
 #define EIGS_ORTHOGONAL_PRECONDITIONER (1<<8)
+#define EIGS_DISTRIBUTE_PRODUCTS (1<<9)
 
 /* default flags: what we think works best most of the time: */
 #define EIGS_DEFAULT_FLAGS (EIGS_RESET_CG | EIGS_REORTHOGONALIZE)
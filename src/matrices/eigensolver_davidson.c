@@ -16,13 +16,22 @@
  */
 
 /* This file contains an alternative eigensolver, currently experimental,
-   based on the Davidson method (a preconditioned variant of Lanczos):
+   based on the block Davidson method (a preconditioned variant of Lanczos):
 
    M. Crouzeix, B. Philippe, and M. Sadkane, "The Davidson Method,"
-   SIAM J. Sci. Comput. 15, no. 1, pp. 62-76 (January 1994). */
+   SIAM J. Sci. Comput. 15, no. 1, pp. 62-76 (January 1994).
+
+   When the subspace fills the workspace, it is "thick" restarted from
+   the current Ritz vectors plus the previous ones, as in the GD+k
+   scheme of:
+
+   A. Stathopoulos and Y. Saad, "Restarting techniques for the
+   (Jacobi-)Davidson symmetric eigenvalue methods," Electron.
+   Trans. Numer. Anal. 7, pp. 163-181 (1998). */
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "config.h"
@@ -41,19 +50,99 @@ extern void eigensolver_get_eigenvals_aux(evectmatrix Y, real *eigenvals,
                                           evectmatrix Work1, evectmatrix Work2,
                                           sqmatrix U, sqmatrix Usqrt,
                                           sqmatrix Uwork);
+extern int eigensolver_orthonormalize_cholqr2(evectmatrix Y, evectmatrix BY,
+					      short B,
+					      sqmatrix R, sqmatrix S);
 
 #define STRINGIZEx(x) #x /* a hack so that we can stringize macro values */
 #define STRINGIZE(x) STRINGIZEx(x)
 
+#define MIN2(a,b) ((a) < (b) ? (a) : (b))
+
 /**************************************************************************/
 
 #define EIGENSOLVER_MAX_ITERATIONS 100000
 #define FEEDBACK_TIME 4.0 /* elapsed time before we print progress feedback */
 
+/* number of rows at a time that basis_XeXCt transforms in place */
+#define CHUNK_ROWS 128
+
+/* a previous Ritz vector whose component orthogonal to the current
+   ones is smaller than this is not kept at a restart */
+#define PREV_TOL 1e-4
+
+/**************************************************************************/
+
+/* Set the first nC / p blocks of the basis X[0..nX-1] (of p columns
+   each), regarded as one n x (nX*p) matrix, to X C^+, where C is
+   nC x (nX*p) with leading dimension ldc.  This is done in place, a
+   chunk of rows at a time, so the only workspace needed is T, with
+   CHUNK_ROWS * (nX*p + nC) entries. */
+static void basis_XeXCt(evectmatrix *X, int nX, scalar *C, int nC, int ldc,
+			scalar *T)
+{
+     int p = X[0].p, q = nX * p, r0, r, ib;
+     scalar *O = T + CHUNK_ROWS * q;
+
+     for (r0 = 0; r0 < X[0].n; r0 += CHUNK_ROWS) {
+	  int nr = MIN2(CHUNK_ROWS, X[0].n - r0);
+
+	  for (r = 0; r < nr; ++r)
+	       for (ib = 0; ib < nX; ++ib)
+		    memcpy(T + r*q + ib*p, X[ib].data + (r0+r) * X[ib].ld,
+			   sizeof(scalar) * p);
+	  blasglue_gemm('N', 'C', nr, nC, q,
+			1.0, T, q, C, ldc, 0.0, O, nC);
+	  for (r = 0; r < nr; ++r)
+	       for (ib = 0; ib * p < nC; ++ib)
+		    memcpy(X[ib].data + (r0+r) * X[ib].ld, O + r*nC + ib*p,
+			   sizeof(scalar) * p);
+     }
+     evectmatrix_flops += X[0].N * X[0].c * nC * (2*q);
+}
+
+/* Orthogonalize the row c (of length q) against the first nrows rows
+   of C (leading dimension ldc, orthonormal), by two passes of
+   Gram-Schmidt, and normalize it.  Returns 0 if c is (nearly) in the
+   span of those rows, in which case it is not normalized.  (Rows here
+   are the conjugated coefficients of vectors in a B-orthonormal basis,
+   so this is B-orthonormalization of the vectors.) */
+static int row_orthonormalize(scalar *c, scalar *C, int nrows, int ldc,
+			      int q)
+{
+     int pass, i, m;
+     real norm2 = 0, s;
+
+     for (pass = 0; pass < 2; ++pass)
+	  for (i = 0; i < nrows; ++i) {
+	       scalar *ci = C + i*ldc, d = SCALAR_INIT_ZERO;
+
+	       for (m = 0; m < q; ++m)
+		    ACCUMULATE_SUM_CONJ_MULT(d, ci[m], c[m]);
+	       for (m = 0; m < q; ++m)
+		    ACCUMULATE_DIFF_SCALAR(c[m], SCALAR_MULT_RE(d, ci[m]),
+					   SCALAR_MULT_IM(d, ci[m]));
+	  }
+
+     for (m = 0; m < q; ++m)
+	  norm2 += SCALAR_NORMSQR(c[m]);
+     if (norm2 < PREV_TOL * PREV_TOL)
+	  return 0;
+     s = 1.0 / sqrt(norm2);
+     for (m = 0; m < q; ++m)
+	  ASSIGN_SCALAR(c[m], SCALAR_RE(c[m]) * s, SCALAR_IM(c[m]) * s);
+     return 1;
+}
+
 /**************************************************************************/
 
+/* Find generalized eigenvectors Y of (A,B) (B may be NULL, for the
+   identity).  The subspace is held in the workspace as nbasis blocks
+   each of V, A V and (if B) B V, where nbasis = nWork/2 (or nWork/3
+   if B), so nWork sets the maximum subspace size of nbasis * Y.p. */
 void eigensolver_davidson(evectmatrix Y, real *eigenvals,
 			  evectoperator A, void *Adata,
+			  evectoperator B, void *Bdata,
 			  evectpreconditioner K, void *Kdata,
 			  evectconstraint constraint, void *constraint_data,
 			  evectmatrix Work[], int nWork,
@@ -61,12 +150,14 @@ void eigensolver_davidson(evectmatrix Y, real *eigenvals,
 			  int flags,
 			  real target)
 {
-     int nbasis, q;
-     evectmatrix *AV, *V;
+     int nbasis, nkeep, q, qmax, qprev = 0;
+     evectmatrix *AV, *V, *BV;
      sqmatrix VAV, S, Swork, U, S2, S3, I;
      mpiglue_clock_t prev_feedback_time;
-     int iteration = 0, ibasis = 0;
+     int iteration = 0, ibasis = 0, num_emergency_restarts = 0;
+     int randomized = 0; /* whether the last new directions were random */
      real *eigenvals2, prev_E = 0;
+     scalar *C, *Cprev, *T;
 
      prev_feedback_time = MPIGLUE_CLOCK;
 
@@ -74,13 +165,18 @@ void eigensolver_davidson(evectmatrix Y, real *eigenvals,
      flags |= EIGS_VERBOSE;
 #endif
 
-     CHECK(nWork >= 4, "not enough workspace");
+     nbasis = nWork / (B ? 3 : 2);
+     CHECK(nbasis >= 2, "not enough workspace");
 
-     nbasis = nWork / 2;
      V = Work;
      AV = Work + nbasis;
+     BV = B ? Work + 2 * nbasis : V;
 
-     q = Y.p * nbasis;
+     /* number of blocks kept at a restart: the current Ritz vectors
+	and, if that leaves room for a new block, the previous ones */
+     nkeep = nbasis >= 3 ? 2 : 1;
+
+     qmax = q = Y.p * nbasis;
      VAV = create_sqmatrix(q);
      S = create_sqmatrix(q);
      Swork = create_sqmatrix(q);
@@ -90,6 +186,9 @@ void eigensolver_davidson(evectmatrix Y, real *eigenvals,
      sqmatrix_resize(&Swork, 0, 0);
 
      CHK_MALLOC(eigenvals2, real, q);
+     CHK_MALLOC(C, scalar, nkeep * Y.p * qmax);
+     CHK_MALLOC(Cprev, scalar, Y.p * qmax);
+     CHK_MALLOC(T, scalar, CHUNK_ROWS * (qmax + nkeep * Y.p));
 
      U = create_sqmatrix(Y.p);
      S2 = create_sqmatrix(Y.p);
@@ -100,10 +199,24 @@ void eigensolver_davidson(evectmatrix Y, real *eigenvals,
      if (constraint)
 	  constraint(Y, constraint_data);
 
-     evectmatrix_XtX(U, Y, S3);
-     CHECK(sqmatrix_invert(U, 1, S3), "singular YtY at start");
-     sqmatrix_sqrt(S2, U, S3); /* S2 = 1/sqrt(Yt*Y) */
-     evectmatrix_XeYS(V[0], Y, S2, 1); /* V[0] = orthonormalize Y */
+     /* V[0] = B-orthonormalize Y */
+     evectmatrix_copy(V[0], Y);
+     if (B)
+	  B(V[0], BV[0], Bdata, 0, AV[0]); /* AV[0] is scratch */
+     if (!eigensolver_orthonormalize_cholqr2(V[0], BV[0], B != NULL,
+					     U, S3)) {
+	  if (B) {
+	       B(Y, BV[0], Bdata, 0, AV[0]);
+	       evectmatrix_XtY(U, Y, BV[0], S3);
+	  }
+	  else
+	       evectmatrix_XtX(U, Y, S3);
+	  CHECK(sqmatrix_invert(U, 1, S3), "singular YtBY at start");
+	  sqmatrix_sqrt(S2, U, S3); /* S2 = 1/sqrt(Yt*B*Y) */
+	  evectmatrix_XeYS(V[0], Y, S2, 1);
+	  if (B)
+	       B(V[0], BV[0], Bdata, 0, AV[0]);
+     }
 
      do {
 	  real E;
@@ -161,62 +274,164 @@ void eigensolver_davidson(evectmatrix Y, real *eigenvals,
                prev_feedback_time = MPIGLUE_CLOCK; /* reset feedback clock */
           }
 
-	  if (iteration > 0 &&
+	  /* (random directions may not change E, so they don't count) */
+	  if (iteration > 0 && !randomized &&
               fabs(E - prev_E) < tolerance * 0.5 * (fabs(E) +
 						    fabs(prev_E) + 1e-7))
                break; /* convergence!  hooray! */
+	  randomized = 0;
 
 	  /* compute new directions from residual & update basis: */
 	  {
-	       int ibasis2 = (ibasis + 1) % nbasis;
-
-	       /* compute V[ibasis2] = AY */
-#if 1
-	       for (i = 0; i <= ibasis; ++i) {
-		    evectmatrix_aXpbYS_sub(i ? 1.0 : 0.0, V[ibasis2],
-					   1.0, AV[i],
-					   S, itarget * q + Y.p * i, 1);
-	       }
-#else
-	       A(Y, V[ibasis2], Adata, 1, Y);
-#endif
-
-	       /* handle restart case: */
-	       if (ibasis2 == 0) {
-		    evectmatrix_copy(AV[0], V[0]);
-		    evectmatrix_copy(V[0], Y);
-		    sqmatrix_resize(&VAV, Y.p, 0);
-		    evectmatrix_XtY(VAV, V[0], AV[0], S3);
-		    ibasis2 = 1;
+	       int ibasis2 = ibasis + 1, j;
+	       evectmatrix BY, W, BW;
+
+	       if (ibasis2 == nbasis) {
+		    /* thick restart: the new basis is the current Ritz
+		       vectors (rows itarget... of S) and the previous
+		       ones (Cprev), B-orthonormalized against them, which
+		       are the conjugate-gradient-like directions.  AV and
+		       BV are transformed along with V, so this needs no
+		       new products with A or B. */
+		    int jnext = 0;
+
+		    for (i = 0; i < Y.p; ++i)
+			 memcpy(C + i*q, S.data + (itarget + i) * q,
+				sizeof(scalar) * q);
+		    for (i = 0; Y.p + i < nkeep * Y.p; ++i) {
+			 scalar *c = C + (Y.p + i) * q;
+
+			 memcpy(c, Cprev + i*qmax, sizeof(scalar) * qprev);
+			 memset(c + qprev, 0, sizeof(scalar) * (q - qprev));
+			 while (!row_orthonormalize(c, C, Y.p + i, q, q)) {
+			      /* previous Ritz vector is already (nearly) in
+				 the current ones, e.g. it has converged: use
+				 a Ritz vector from outside the window */
+			      CHECK(jnext < q - Y.p,
+				    "no vectors left for restart");
+			      memcpy(c, S.data
+				     + ((itarget + Y.p + jnext++) % q) * q,
+				     sizeof(scalar) * q);
+			 }
+		    }
+
+		    basis_XeXCt(V, nbasis, C, nkeep * Y.p, q, T);
+		    basis_XeXCt(AV, nbasis, C, nkeep * Y.p, q, T);
+		    if (B)
+			 basis_XeXCt(BV, nbasis, C, nkeep * Y.p, q, T);
+
+		    sqmatrix_resize(&VAV, nkeep * Y.p, 0);
+		    for (j = 0; j < nkeep; ++j)
+			 for (i = 0; i <= j; ++i)
+			      evectmatrixXtY_sub(VAV, Y.p * (VAV.p * i + j),
+						 V[i], AV[j], S3);
+
+		    ibasis = nkeep - 1;
+		    ibasis2 = nkeep;
+
+		    /* Y is now V[0], so AY = AV[0] and BY = BV[0] */
 		    evectmatrix_copy(V[ibasis2], AV[0]);
-	       }
+		    BY = BV[0];
 
-	       /* V[ibasis2] = residual = AY - Y * eigenvals */
-	       matrix_XpaY_diag_real(V[ibasis2].data,
-				     -1.0, Y.data,
-				     eigenvals, Y.n, Y.p);
+		    for (i = 0; i < Y.p; ++i)
+			 for (j = 0; j < Y.p; ++j)
+			      ASSIGN_SCALAR(Cprev[i*qmax + j], i == j, 0);
+		    qprev = Y.p;
+	       }
+	       else {
+		    /* compute V[ibasis2] = AY, and (if B)
+		       BV[ibasis2] = BY until it is overwritten below */
+		    for (i = 0; i <= ibasis; ++i) {
+			 evectmatrix_aXpbYS_sub(i ? 1.0 : 0.0, V[ibasis2],
+						1.0, AV[i],
+						S, itarget * q + Y.p * i, 1);
+			 if (B)
+			      evectmatrix_aXpbYS_sub(i ? 1.0 : 0.0,
+						     BV[ibasis2], 1.0, BV[i],
+						     S, itarget * q + Y.p * i,
+						     1);
+		    }
+		    BY = B ? BV[ibasis2] : Y;
+
+		    /* remember the Ritz vectors, for the next restart */
+		    for (i = 0; i < Y.p; ++i)
+			 memcpy(Cprev + i*qmax, S.data + (itarget + i) * q,
+				sizeof(scalar) * q);
+		    qprev = q;
+	       }
 
-	       /* AV[ibasis2] = precondition V[ibasis2]: */
+	       /* V[ibasis2] = residual = AY - BY * eigenvals */
+	       if (EVECTMATRIX_CONTIGUOUS(BY))
+		    matrix_XpaY_diag_real(V[ibasis2].data,
+					  -1.0, BY.data,
+					  eigenvals, BY.n, BY.p);
+	       else /* BY is a view: one row at a time */
+		    for (i = 0; i < BY.n; ++i)
+			 matrix_XpaY_diag_real(V[ibasis2].data + i * BY.p,
+					       -1.0, BY.data + i * BY.ld,
+					       eigenvals, 1, BY.p);
+
+	       /* W = AV[ibasis2] = precondition V[ibasis2]: */
+	       W = AV[ibasis2];
 	       if (K != NULL)
-		    K(V[ibasis2], AV[ibasis2], Kdata, Y, eigenvals, I);
+		    K(V[ibasis2], W, Kdata, Y, eigenvals, I);
 	       else
-		    evectmatrix_copy(AV[ibasis2], V[ibasis2]);
+		    evectmatrix_copy(W, V[ibasis2]);
 
+	       /* BW = BV[ibasis2] = B W, kept current as W is updated: */
+	       BW = B ? BV[ibasis2] : W;
+
+	  restartW:
 	       /* project by the constraints, if any: */
 	       if (constraint)
-		    constraint(AV[ibasis2], constraint_data);
+		    constraint(W, constraint_data);
+
+	       if (B)
+		    B(W, BW, Bdata, 0, V[ibasis2]); /* V[ibasis2] is scratch */
 
-	       /* orthogonalize against previous V: */
+	       /* B-orthogonalize against previous V: */
 	       for (i = 0; i < ibasis2; ++i) {
-		    evectmatrix_XtY(U, V[i], AV[ibasis2], S3);
-		    evectmatrix_XpaYS(AV[ibasis2], -1.0, V[i], U, 0);
+		    evectmatrix_XtY(U, V[i], BW, S3);
+		    evectmatrix_XpaYS(W, -1.0, V[i], U, 0);
+		    if (B)
+			 evectmatrix_XpaYS(BW, -1.0, BV[i], U, 0);
 	       }
 
-	       /* orthonormalize within itself: */
-	       evectmatrix_XtX(U, AV[ibasis2], S3);
-	       CHECK(sqmatrix_invert(U, 1, S3), "non-independent AV subspace");
-	       sqmatrix_sqrt(S2, U, S3);
-	       evectmatrix_XeYS(V[ibasis2], AV[ibasis2], S2, 1);
+	       /* B-orthonormalize within itself: */
+	       if (eigensolver_orthonormalize_cholqr2(W, BW, B != NULL,
+						      U, S3))
+		    evectmatrix_copy(V[ibasis2], W);
+	       else { /* ill-conditioned: fall back to 1/sqrt(Wt*B*W) */
+		    if (B)
+			 evectmatrix_XtY(U, W, BW, S3);
+		    else
+			 evectmatrix_XtX(U, W, S3);
+		    if (!sqmatrix_invert(U, 1, S3)) {
+			 /* the new directions are (nearly) dependent on
+			    each other or on V, as happens when the
+			    residuals of (nearly) degenerate bands have
+			    almost converged: emergency restart of W with
+			    random directions, which still extend V */
+			 CHECK(iteration + 10 * ++num_emergency_restarts
+			       < EIGENSOLVER_MAX_ITERATIONS,
+			       "too many emergency restarts");
+			 if (mpb_verbosity >= 1)
+			      mpi_one_printf("    emergency randomization of "
+					     "new directions on iter. %d\n",
+					     iteration);
+			 for (i = 0; i < W.n; ++i)
+			      for (j = 0; j < W.p; ++j)
+				   ASSIGN_SCALAR(W.data[i * W.ld + j],
+						 rand() * 1.0 / RAND_MAX - 0.5,
+						 rand() * 1.0 / RAND_MAX - 0.5);
+			 randomized = 1;
+			 goto restartW;
+		    }
+		    sqmatrix_sqrt(S2, U, S3);
+		    evectmatrix_XeYS(V[ibasis2], W, S2, 1);
+		    if (B)
+			 B(V[ibasis2], BV[ibasis2], Bdata, 0, W);
+	       }
 
 	       ibasis = ibasis2;
 	  }
@@ -229,11 +444,19 @@ void eigensolver_davidson(evectmatrix Y, real *eigenvals,
            STRINGIZE(EIGENSOLVER_MAX_ITERATIONS)
            " iterations");
 
-     evectmatrix_XtX(U, Y, S3);
-     CHECK(sqmatrix_invert(U, 1, S3), "singular YtY at end");
+     if (B) {
+	  B(Y, BV[0], Bdata, 1, AV[0]); /* AV[0] is scratch */
+	  evectmatrix_XtY(U, Y, BV[0], S3);
+     }
+     else
+	  evectmatrix_XtX(U, Y, S3);
+     CHECK(sqmatrix_invert(U, 1, S3), "singular YtBY at end");
      eigensolver_get_eigenvals_aux(Y, eigenvals, A, Adata,
 				   V[0], AV[0], U, S3, S2);
 
+     free(T);
+     free(Cprev);
+     free(C);
      free(eigenvals2);
 
      destroy_sqmatrix(VAV);
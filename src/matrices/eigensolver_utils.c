@@ -45,6 +45,34 @@ void eigensolver_get_eigenvals_aux(evectmatrix Y, real *eigenvals,
      evectmatrix_XeYS(Y, Work1, U, 1);
 }
 
+/* Orthonormalize Y in place by CholeskyQR2: twice, Y <- Y / R where
+   Yt B Y = Rt R is a Cholesky factorization.  (The second pass cleans
+   up the loss of orthogonality from the first, which grows as the
+   square of the condition number of Y.)  Unlike Y / sqrt(Yt B Y), this
+   needs no eigendecomposition or extra copy of Y.  If B, then BY = B Y
+   on input and is updated to match Y.  R and S are scratch.  Returns 0
+   if Yt B Y is too ill-conditioned to factorize, in which case the
+   caller should fall back to the square root (Y is still a valid basis,
+   but may have been partially orthonormalized). */
+int eigensolver_orthonormalize_cholqr2(evectmatrix Y, evectmatrix BY, short B,
+				       sqmatrix R, sqmatrix S)
+{
+     int pass;
+
+     for (pass = 0; pass < 2; ++pass) {
+	  if (B)
+	       evectmatrix_XtY(R, Y, BY, S);
+	  else
+	       evectmatrix_XtX(R, Y, S);
+	  if (!sqmatrix_cholesky(R))
+	       return 0;
+	  evectmatrix_XeXRinv(Y, R);
+	  if (B)
+	       evectmatrix_XeXRinv(BY, R);
+     }
+     return 1;
+}
+
 void eigensolver_get_eigenvals(evectmatrix Y, real *eigenvals,
 			       evectoperator A, void *Adata,
 			       evectmatrix Work1, evectmatrix Work2)
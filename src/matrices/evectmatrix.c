@@ -31,14 +31,25 @@ double evectmatrix_flops = 0;
 
 /* Operations on evectmatrix blocks:
        X + a Y, X * S, X + a Y * S, Xt * X, Xt * Y, trace(Xt * Y), etc.
-   (X, Y: evectmatrix, S: sqmatrix) */
+   (X, Y: evectmatrix, S: sqmatrix)
+
+   X and Y may be views of a range of columns of a larger matrix
+   (see evectmatrix_view), in which case their rows are X.ld apart.
+   The BLAS routines handle this via their leading-dimension
+   arguments; the level-1 operations fall back to a loop over rows. */
 
 /* X = Y */
 void evectmatrix_copy(evectmatrix X, evectmatrix Y)
 {
      CHECK(X.n == Y.n && X.p == Y.p, "arrays not conformant");
 
-     blasglue_copy(X.n * X.p, Y.data, 1, X.data, 1);
+     if (EVECTMATRIX_CONTIGUOUS(X) && EVECTMATRIX_CONTIGUOUS(Y))
+	  blasglue_copy(X.n * X.p, Y.data, 1, X.data, 1);
+     else {
+	  int i;
+	  for (i = 0; i < X.n; ++i)
+	       blasglue_copy(X.p, Y.data + i * Y.ld, 1, X.data + i * X.ld, 1);
+     }
 }
 
 /* set p selected columns of X to those in Y, starting at ix and iy.  */
@@ -51,12 +62,12 @@ void evectmatrix_copy_slice(evectmatrix X, evectmatrix Y,
      if (ix == 0 && iy == 0 && p == X.p && p == Y.p)
 	  evectmatrix_copy(X, Y);
      else if (p == 1)
-	  blasglue_copy(X.n, Y.data + iy, Y.p, X.data + ix, X.p);
+	  blasglue_copy(X.n, Y.data + iy, Y.ld, X.data + ix, X.ld);
      else {
 	  int i;
 	  for (i = 0; i < X.n; ++i)
-	       blasglue_copy(p, Y.data + iy + i * Y.p, 1,
-			     X.data + ix + i * X.p, 1);
+	       blasglue_copy(p, Y.data + iy + i * Y.ld, 1,
+			     X.data + ix + i * X.ld, 1);
      }
 }
 
@@ -64,10 +75,11 @@ void evectmatrix_copy_slice(evectmatrix X, evectmatrix Y,
    A was initially allocated to hold at least this big a matrix.
    If preserve_data is nonzero, copies the existing data in A (or
    a subset of it, if the matrix is shrinking) to the corresponding
-   entries of the resized matrix. */
+   entries of the resized matrix.  (Views cannot be resized.) */
 void evectmatrix_resize(evectmatrix *A, int p, short preserve_data)
 {
      CHECK(p <= A->alloc_p, "tried to resize beyond allocated limit");
+     CHECK(EVECTMATRIX_CONTIGUOUS(*A), "tried to resize an evectmatrix view");
 
      if (preserve_data) {
 	  int i, j;
@@ -84,18 +96,30 @@ void evectmatrix_resize(evectmatrix *A, int p, short preserve_data)
 	  }
      }
 
-     A->p = p;
+     A->ld = A->p = p;
 }
 
-/* compute X = a*X + b*Y; X and Y may be equal. */
+/* compute X = a*X + b*Y; X and Y may be equal (b == 0 just scales X). */
 void evectmatrix_aXpbY(real a, evectmatrix X, real b, evectmatrix Y)
 {
      CHECK(X.n == Y.n && X.p == Y.p, "arrays not conformant");
      
-     if (a != 1.0)
-	  blasglue_rscal(X.n * X.p, a, X.data, 1);
-
-     blasglue_axpy(X.n * X.p, b, Y.data, 1, X.data, 1);
+     if (EVECTMATRIX_CONTIGUOUS(X) && EVECTMATRIX_CONTIGUOUS(Y)) {
+	  if (a != 1.0)
+	       blasglue_rscal(X.n * X.p, a, X.data, 1);
+	  if (b != 0.0)
+	       blasglue_axpy(X.n * X.p, b, Y.data, 1, X.data, 1);
+     }
+     else {
+	  int i;
+	  for (i = 0; i < X.n; ++i) {
+	       if (a != 1.0)
+		    blasglue_rscal(X.p, a, X.data + i * X.ld, 1);
+	       if (b != 0.0)
+		    blasglue_axpy(X.p, b, Y.data + i * Y.ld, 1,
+				  X.data + i * X.ld, 1);
+	  }
+     }
      evectmatrix_flops += X.N * X.c * X.p * 3;
 }
 
@@ -114,8 +138,8 @@ void evectmatrix_aXpbYS_sub(real a, evectmatrix X, real b, evectmatrix Y,
 	  CHECK(Soffset + (Y.p-1)*S.p + Y.p <= S.p*S.p,
 		"submatrix exceeds matrix bounds");
 	  blasglue_gemm('N', sdagger ? 'C' : 'N', X.n, X.p, X.p,
-			b, Y.data, Y.p, S.data + Soffset, S.p,
-			a, X.data, X.p);
+			b, Y.data, Y.ld, S.data + Soffset, S.p,
+			a, X.data, X.ld);
 	  evectmatrix_flops += X.N * X.c * X.p * (3 + 2 * X.p);
      }
 }
@@ -128,6 +152,16 @@ void evectmatrix_XeYS(evectmatrix X, evectmatrix Y, sqmatrix S, short sherm)
      evectmatrix_aXpbYS_sub(0.0, X, 1.0, Y, S, 0, sherm);
 }
 
+/* compute X = X * 1/R in place, where R is upper-triangular (only
+   the upper triangle is used), e.g. from sqmatrix_cholesky. */
+void evectmatrix_XeXRinv(evectmatrix X, sqmatrix R)
+{
+     CHECK(R.p == X.p, "arrays not conformant");
+     blasglue_trsm('R', 'U', 'N', 'N', X.n, X.p, 1.0, R.data, R.p,
+		   X.data, X.ld);
+     evectmatrix_flops += X.N * X.c * X.p * X.p;
+}
+
 /* compute X += a Y * S.  If sdagger != 0, then St is used instead of S. */
 void evectmatrix_XpaYS(evectmatrix X, real a, evectmatrix Y,
 		       sqmatrix S, short sdagger)
@@ -149,7 +183,7 @@ void evectmatrix_XtX(sqmatrix U, evectmatrix X, sqmatrix S)
      /* take advantage of the fact that U is Hermitian and only write
 	out the upper triangle of the matrix */
      memset(S.data, 0, sizeof(scalar) * (U.p * U.p));
-     blasglue_herk('U', 'C', X.p, X.n, 1.0, X.data, X.p, 0.0, S.data, U.p);
+     blasglue_herk('U', 'C', X.p, X.n, 1.0, X.data, X.ld, 0.0, S.data, U.p);
      evectmatrix_flops += X.N * X.c * X.p * (X.p - 1);
 
      /* Now, copy the conjugate of the upper half onto the lower half of S */
@@ -179,7 +213,7 @@ void evectmatrix_XtY_slice2(sqmatrix U, evectmatrix X, evectmatrix Y,
     
     memset(S1.data, 0, sizeof(scalar) * (U.p * U.p));
     blasglue_gemm('C', 'N', p, q, X.n,
-                  1.0, X.data + ix, X.p, Y.data + iy, Y.p, 0.0,
+                  1.0, X.data + ix, X.ld, Y.data + iy, Y.ld, 0.0,
                   S1.data, q);
     evectmatrix_flops += X.N * X.c * q * (2*p);
     
@@ -221,7 +255,7 @@ void evectmatrixXtY_sub(sqmatrix U, int Uoffset, evectmatrix X, evectmatrix Y,
      
      memset(S.data, 0, sizeof(scalar) * (Y.p * Y.p));
      blasglue_gemm('C', 'N', X.p, X.p, X.n,
-		   1.0, X.data, X.p, Y.data, Y.p, 0.0, S.data, Y.p);
+		   1.0, X.data, X.ld, Y.data, Y.ld, 0.0, S.data, Y.p);
      evectmatrix_flops += X.N * X.c * X.p * (2*X.p);
 
      for (i = 0; i < Y.p; ++i) {
@@ -236,7 +270,20 @@ void evectmatrixXtY_sub(sqmatrix U, int Uoffset, evectmatrix X, evectmatrix Y,
 void evectmatrix_XtY_diag(evectmatrix X, evectmatrix Y, scalar *diag,
 			  scalar *scratch_diag)
 {
-     matrix_XtY_diag(X.data, Y.data, X.n, X.p, scratch_diag);
+     if (EVECTMATRIX_CONTIGUOUS(X) && EVECTMATRIX_CONTIGUOUS(Y))
+	  matrix_XtY_diag(X.data, Y.data, X.n, X.p, scratch_diag);
+     else {
+	  int i, j;
+	  for (j = 0; j < X.p; ++j) {
+	       ASSIGN_ZERO(scratch_diag[j]);
+	  }
+	  for (i = 0; i < X.n; ++i)
+	       for (j = 0; j < X.p; ++j) {
+		    ACCUMULATE_SUM_CONJ_MULT(scratch_diag[j],
+					     X.data[i*X.ld+j],
+					     Y.data[i*Y.ld+j]);
+	       }
+     }
      evectmatrix_flops += X.N * X.c * X.p * 2;
      mpi_allreduce(scratch_diag, diag, X.p * SCALAR_NUMVALS, 
 		   real, SCALAR_MPI_TYPE, MPI_SUM, mpb_comm);
@@ -246,7 +293,19 @@ void evectmatrix_XtY_diag(evectmatrix X, evectmatrix Y, scalar *diag,
 void evectmatrix_XtY_diag_real(evectmatrix X, evectmatrix Y, real *diag,
 			       real *scratch_diag)
 {
-     matrix_XtY_diag_real(X.data, Y.data, X.n, X.p, scratch_diag);
+     if (EVECTMATRIX_CONTIGUOUS(X) && EVECTMATRIX_CONTIGUOUS(Y))
+	  matrix_XtY_diag_real(X.data, Y.data, X.n, X.p, scratch_diag);
+     else {
+	  int i, j;
+	  for (j = 0; j < X.p; ++j)
+	       scratch_diag[j] = 0;
+	  for (i = 0; i < X.n; ++i)
+	       for (j = 0; j < X.p; ++j) {
+		    scalar x = X.data[i*X.ld+j], y = Y.data[i*Y.ld+j];
+		    scratch_diag[j] += (SCALAR_RE(x) * SCALAR_RE(y) +
+					SCALAR_IM(x) * SCALAR_IM(y));
+	       }
+     }
      evectmatrix_flops += X.N * X.c * X.p * (2*X.p);
      mpi_allreduce(scratch_diag, diag, X.p,
 		   real, SCALAR_MPI_TYPE, MPI_SUM, mpb_comm);
@@ -255,7 +314,17 @@ void evectmatrix_XtY_diag_real(evectmatrix X, evectmatrix Y, real *diag,
 /* As above, but compute only the diagonal elements of XtX. */
 void evectmatrix_XtX_diag_real(evectmatrix X, real *diag, real *scratch_diag)
 {
-     matrix_XtX_diag_real(X.data, X.n, X.p, scratch_diag);
+     if (EVECTMATRIX_CONTIGUOUS(X))
+	  matrix_XtX_diag_real(X.data, X.n, X.p, scratch_diag);
+     else {
+	  int i, j;
+	  for (j = 0; j < X.p; ++j)
+	       scratch_diag[j] = 0;
+	  for (i = 0; i < X.n; ++i)
+	       for (j = 0; j < X.p; ++j) {
+		    ACCUMULATE_SUM_SQ(scratch_diag[j], X.data[i*X.ld+j]);
+	       }
+     }
      evectmatrix_flops += X.N * X.c * X.p * (2*X.p);
      mpi_allreduce(scratch_diag, diag, X.p,
 		   real, SCALAR_MPI_TYPE, MPI_SUM, mpb_comm);
@@ -268,7 +337,17 @@ scalar evectmatrix_traceXtY(evectmatrix X, evectmatrix Y)
 
      CHECK(X.p == Y.p && X.n == Y.n, "matrices not conformant");
      
-     trace_scratch = blasglue_dotc(X.n * X.p, X.data, 1, Y.data, 1);
+     if (EVECTMATRIX_CONTIGUOUS(X) && EVECTMATRIX_CONTIGUOUS(Y))
+	  trace_scratch = blasglue_dotc(X.n * X.p, X.data, 1, Y.data, 1);
+     else {
+	  int i;
+	  ASSIGN_ZERO(trace_scratch);
+	  for (i = 0; i < X.n; ++i) {
+	       scalar t = blasglue_dotc(X.p, X.data + i * X.ld, 1,
+					Y.data + i * Y.ld, 1);
+	       ACCUMULATE_SUM(trace_scratch, t);
+	  }
+     }
      evectmatrix_flops += X.N * X.c * X.p * (2*X.p) + X.p;
 
      mpi_allreduce(&trace_scratch, &trace, SCALAR_NUMVALS,
@@ -20,6 +20,7 @@
 
 #include "config.h"
 #include <check.h>
+#include <large_malloc.h>
 
 #include "matrices.h"
 
@@ -40,10 +41,10 @@ evectmatrix create_evectmatrix(int N, int c, int p,
      X.c = c;
      
      X.n = localN * c;
-     X.alloc_p = X.p = p;
+     X.ld = X.alloc_p = X.p = p;
      
      if (allocN > 0) {
-	  CHK_MALLOC(X.data, scalar, allocN * c * p);
+	  CHK_LARGE_MALLOC(X.data, scalar, allocN * c * p);
      }
      else
 	  X.data = NULL;
@@ -53,7 +54,23 @@ evectmatrix create_evectmatrix(int N, int c, int p,
 
 void destroy_evectmatrix(evectmatrix X)
 {
-     free(X.data);
+     large_free(X.data);
+}
+
+/* Return a view of the p columns of X starting at column ix.  The view
+   shares the data of X (with row stride X.ld), so operations on the
+   view act on those columns of X in place; it must not be destroyed
+   or resized (make a new view instead). */
+evectmatrix evectmatrix_view(evectmatrix X, int ix, int p)
+{
+     evectmatrix V = X;
+
+     CHECK(ix >= 0 && p >= 0 && ix + p <= X.p,
+	   "invalid arguments to evectmatrix_view");
+     V.alloc_p = V.p = p;
+     if (X.data)
+	  V.data = X.data + ix;
+     return V;
 }
 
 sqmatrix create_sqmatrix(int p)
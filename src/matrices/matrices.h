@@ -28,9 +28,13 @@ typedef struct {
      int N, localN, Nstart, allocN;
      int c;
      int n, p, alloc_p;
+     int ld; /* row stride of data: ld == p, except for a view of a
+		range of columns of a larger matrix (see evectmatrix_view) */
      scalar *data;
 } evectmatrix;
 
+#define EVECTMATRIX_CONTIGUOUS(X) ((X).ld == (X).p)
+
 typedef struct {
      int p, alloc_p;
      scalar *data;
@@ -44,6 +48,7 @@ extern double evectmatrix_flops;
 extern evectmatrix create_evectmatrix(int N, int c, int p,
 				      int localN, int Nstart, int allocN);
 extern void destroy_evectmatrix(evectmatrix X);
+extern evectmatrix evectmatrix_view(evectmatrix X, int ix, int p);
 extern sqmatrix create_sqmatrix(int p);
 extern void destroy_sqmatrix(sqmatrix X);
 
@@ -76,6 +81,7 @@ extern void evectmatrix_aXpbYS_sub(real a, evectmatrix X,
 				   sqmatrix S, int Soffset, short sdagger);
 extern void evectmatrix_XeYS(evectmatrix X, evectmatrix Y,
 			     sqmatrix S, short sherm);
+extern void evectmatrix_XeXRinv(evectmatrix X, sqmatrix R);
 extern void evectmatrix_XpaYS(evectmatrix X, real a, evectmatrix Y,
 			      sqmatrix S, short sdagger);
 extern void evectmatrix_XtX(sqmatrix U, evectmatrix X, sqmatrix S);
@@ -105,6 +111,7 @@ extern void sqmatrix_copy_upper2full(sqmatrix F, sqmatrix U);
 extern void sqmatrix_symmetrize(sqmatrix Asym, sqmatrix A);
 extern scalar sqmatrix_trace(sqmatrix U);
 extern scalar sqmatrix_traceAtB(sqmatrix A, sqmatrix B);
+extern void sqmatrix_distribute_products(int p);
 extern void sqmatrix_AeBC(sqmatrix A, sqmatrix B, short bdagger,
 			  sqmatrix C, short cdagger);
 extern void sqmatrix_ApaBC(sqmatrix A, real a, sqmatrix B, short bdagger,
@@ -113,6 +120,7 @@ extern void sqmatrix_ApaB(sqmatrix A, real a, sqmatrix B);
 extern void sqmatrix_aApbB(real a, sqmatrix A, real b, sqmatrix B);
 extern int sqmatrix_invert(sqmatrix U, short positive_definite,
 			    sqmatrix Work);
+extern int sqmatrix_cholesky(sqmatrix U);
 extern void sqmatrix_eigensolve(sqmatrix U, real *eigenvals, sqmatrix W);
 extern void sqmatrix_gen_eigensolve(sqmatrix U, sqmatrix B, real *eigenvals, sqmatrix W);
 extern void sqmatrix_eigenvalues(sqmatrix A, scalar_complex *eigenvals);
@@ -20,6 +20,7 @@
 #include <math.h>
 
 #include "config.h"
+#include <mpiglue.h>
 #include <check.h>
 
 #include "matrices.h"
@@ -151,6 +152,87 @@ scalar sqmatrix_traceAtB(sqmatrix A, sqmatrix B)
      return trace;
 }
 
+#ifdef HAVE_MPI
+/* State for sqmatrix_distribute_products: the size p of the products
+   that are split among the processes (0 if none), and the buffers
+   for gathering them, which are kept between products. */
+static int distribute_p = 0;
+static int *distribute_counts = NULL, *distribute_displs = NULL;
+static scalar *distribute_rows = NULL;
+#endif
+
+/* Under MPI, every process holds identical copies of the sqmatrices,
+   and would otherwise redundantly compute the same O(p^3) products.
+   After calling this with p > 0, sqmatrix_AeBC and sqmatrix_ApaBC
+   instead compute only a slab of rows of each p x p product on each
+   process and then gather the result, at the cost of an all-gather of
+   p^2 scalars per product.  This is only worthwhile when p is large.
+   Call it with p = 0 to go back to redundant products and to free
+   the gather buffers.  (Does nothing without MPI.) */
+void sqmatrix_distribute_products(int p)
+{
+#ifdef HAVE_MPI
+     int np, rank, i, rows;
+
+     free(distribute_rows);
+     free(distribute_counts);
+     distribute_rows = NULL;
+     distribute_counts = distribute_displs = NULL;
+     distribute_p = p;
+     if (p <= 0)
+	  return;
+
+     MPI_Comm_size(mpb_comm, &np);
+     MPI_Comm_rank(mpb_comm, &rank);
+     CHK_MALLOC(distribute_counts, int, 2 * np);
+     distribute_displs = distribute_counts + np;
+     for (i = 0; i < np; ++i) {
+	  int start = (i * p) / np, end = ((i + 1) * p) / np;
+	  distribute_displs[i] = start * p * SCALAR_NUMVALS;
+	  distribute_counts[i] = (end - start) * p * SCALAR_NUMVALS;
+     }
+     rows = ((rank + 1) * p) / np - (rank * p) / np;
+     CHK_MALLOC(distribute_rows, scalar, rows * p + 1);
+#else
+     (void) p;
+#endif
+}
+
+/* A = a B * C + b A, with bdagger and cdagger as for sqmatrix_AeBC. */
+static void sqmatrix_gemm(sqmatrix A, real a, sqmatrix B, short bdagger,
+			  sqmatrix C, short cdagger, real b)
+{
+     CHECK(A.p == B.p && A.p == C.p, "matrices not conformant");
+
+#ifdef HAVE_MPI
+     if (distribute_p > 0 && A.p == distribute_p) {
+	  int np, rank, row_start, rows;
+
+	  MPI_Comm_size(mpb_comm, &np);
+	  MPI_Comm_rank(mpb_comm, &rank);
+	  row_start = (rank * A.p) / np;
+	  rows = ((rank + 1) * A.p) / np - row_start;
+
+	  /* compute our rows in a separate buffer, since we can't
+	     gather in place without MPI_IN_PLACE: */
+	  if (b != 0.0)
+	       blasglue_copy(rows * A.p, A.data + row_start * A.p, 1,
+			     distribute_rows, 1);
+	  blasglue_gemm(bdagger ? 'C' : 'N', cdagger ? 'C' : 'N',
+			rows, A.p, A.p, a,
+			B.data + (bdagger ? row_start : row_start * B.p), B.p,
+			C.data, C.p, b, distribute_rows, A.p);
+	  MPI_Allgatherv(distribute_rows, distribute_counts[rank],
+			 SCALAR_MPI_TYPE, A.data, distribute_counts,
+			 distribute_displs, SCALAR_MPI_TYPE, mpb_comm);
+	  return;
+     }
+#endif
+
+     blasglue_gemm(bdagger ? 'C' : 'N', cdagger ? 'C' : 'N', A.p, A.p, A.p,
+                   a, B.data, B.p, C.data, C.p, b, A.data, A.p);
+}
+
 /* A = B * C.  If bdagger != 0, then adjoint(B) is used; similarly for C. 
    A must be distinct from B and C.   Note that since the matrices
    are stored in row-major order, the most efficient operation should
@@ -160,20 +242,14 @@ scalar sqmatrix_traceAtB(sqmatrix A, sqmatrix B)
 void sqmatrix_AeBC(sqmatrix A, sqmatrix B, short bdagger,
 		   sqmatrix C, short cdagger)
 {
-     CHECK(A.p == B.p && A.p == C.p, "matrices not conformant");
-
-     blasglue_gemm(bdagger ? 'C' : 'N', cdagger ? 'C' : 'N', A.p, A.p, A.p,
-                   1.0, B.data, B.p, C.data, C.p, 0.0, A.data, A.p);
+     sqmatrix_gemm(A, 1.0, B, bdagger, C, cdagger, 0.0);
 }
 
 /* A += a B * C.  bdagger, cdagger are as for sqmatrix_AeBC, above. */
 void sqmatrix_ApaBC(sqmatrix A, real a, sqmatrix B, short bdagger,
 		    sqmatrix C, short cdagger)
 {
-     CHECK(A.p == B.p && A.p == C.p, "matrices not conformant");
-
-     blasglue_gemm(bdagger ? 'C' : 'N', cdagger ? 'C' : 'N', A.p, A.p, A.p,
-                   a, B.data, B.p, C.data, C.p, 1.0, A.data, A.p);
+     sqmatrix_gemm(A, a, B, bdagger, C, cdagger, 1.0);
 }
 
 /* A += a B */
@@ -244,6 +320,16 @@ int sqmatrix_invert(sqmatrix U, short positive_definite,
      return 1;
 }
 
+/* U <- R, the upper-triangular Cholesky factor of U = adjoint(R) R,
+   where U must be Hermitian; the lower triangle of U is left
+   unchanged.  Returns 1 on success, 0 if U is not (numerically)
+   positive-definite. */
+int sqmatrix_cholesky(sqmatrix U)
+{
+     sqmatrix_assert_hermitian(U);
+     return lapackglue_potrf('U', U.p, U.data, U.p);
+}
+
 /* U <- eigenvectors of Ux=lambda B x, while B is overwritten (by its
    Cholesky factors).  U and B must be Hermitian, and B must be
    positive-definite; if B==NULL then it is taken to be the
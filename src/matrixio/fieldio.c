@@ -29,6 +29,113 @@
 
 #define TWOPI 6.2831853071795864769252867665590057683943388
 #define MAX2(a,b) ((a) > (b) ? (a) : (b))
+#define MIN2(a,b) ((a) < (b) ? (a) : (b))
+
+/**************************************************************************/
+
+/* The region of the grid written by the functions below: the points
+   region_start[i], region_start[i] + region_stride, ... (up to
+   region_end[i], inclusive) along each dimension i of the dims[] passed
+   to them, which are written as a correspondingly smaller dataset.
+   region_stride == 0 if the whole grid is written (the default). */
+static int region_start[3], region_end[3], region_stride = 0;
+
+/* Restrict the output of the functions below to the given box of
+   grid points (inclusive, and clipped to the grid), keeping only every
+   decimation-th point along each dimension starting from start[i].
+   If start or end is NULL, the whole grid is written (the default). */
+void fieldio_set_region(const int start[3], const int end[3],
+			int decimation)
+{
+     int i;
+
+     CHECK(decimation > 0, "non-positive decimation factor");
+     if (!start || !end) {
+	  region_stride = decimation > 1 ? decimation : 0;
+	  for (i = 0; i < 3; ++i) {
+	       region_start[i] = 0;
+	       region_end[i] = -1; /* = the end of each dimension */
+	  }
+	  return;
+     }
+     region_stride = decimation;
+     for (i = 0; i < 3; ++i) {
+	  region_start[i] = start[i];
+	  region_end[i] = end[i];
+     }
+}
+
+/* Compute the first and last grid points of the region along dimension
+   i of dims (both within the grid). */
+static void region_bounds(const int dims[3], int i, int *lo, int *hi)
+{
+     *lo = MIN2(MAX2(region_start[i], 0), dims[i] - 1);
+     *hi = region_end[i] < 0 ? dims[i] - 1 : MIN2(region_end[i], dims[i] - 1);
+     *hi = MAX2(*hi, *lo);
+}
+
+/* Compute the dims of the dataset written for the region, and its
+   rank (dropping trailing dimensions of size 1, as below). */
+static int region_dims(const int dims[3], int rdims[3])
+{
+     int i;
+
+     for (i = 0; i < 3; ++i) {
+	  int lo, hi;
+	  if (!region_stride) {
+	       rdims[i] = dims[i];
+	       continue;
+	  }
+	  region_bounds(dims, i, &lo, &hi);
+	  rdims[i] = (hi - lo) / region_stride + 1;
+     }
+     return rdims[2] == 1 ? (rdims[1] == 1 ? 1 : 2) : 3;
+}
+
+/* Write the real numbers at the given stride in the local array data,
+   with dimensions local_dims at start within dims, to data_id: only the
+   points in the region, copied to a contiguous array, at the
+   corresponding hyperslab of the (smaller) dataset.  Each process
+   writes its own part of the region, which may be empty. */
+static void write_region_data(matrixio_id data_id, const int dims[3],
+			      const int local_dims[3], const int start[3],
+			      int stride, real *data)
+{
+     int rlocal_dims[3], rstart[3], offset[3], i, j, k, n;
+     real *buf;
+
+     if (!region_stride) {
+	  matrixio_write_real_data(data_id, local_dims, start, stride, data);
+	  return;
+     }
+
+     for (i = 0; i < 3; ++i) {
+	  int lo, hi, first, last;
+	  region_bounds(dims, i, &lo, &hi);
+	  first = MAX2(start[i], lo);
+	  rstart[i] = (first - lo + region_stride - 1) / region_stride;
+	  first = lo + rstart[i] * region_stride;
+	  last = MIN2(start[i] + local_dims[i] - 1, hi);
+	  offset[i] = first - start[i];
+	  rlocal_dims[i] = first > last ? 0 : (last - first) / region_stride + 1;
+     }
+
+     n = rlocal_dims[0] * rlocal_dims[1] * rlocal_dims[2];
+     CHK_MALLOC(buf, real, MAX2(n, 1));
+     n = 0;
+     for (i = 0; i < rlocal_dims[0]; ++i)
+	  for (j = 0; j < rlocal_dims[1]; ++j) {
+	       int ij = ((offset[0] + i * region_stride) * local_dims[1]
+			 + offset[1] + j * region_stride) * local_dims[2]
+		    + offset[2];
+	       for (k = 0; k < rlocal_dims[2]; ++k)
+		    buf[n++] = data[(ij + k * region_stride) * stride];
+	  }
+     matrixio_write_real_data(data_id, rlocal_dims, rstart, 1, buf);
+     free(buf);
+}
+
+/**************************************************************************/
 
 /* note that kvector here is given in the reciprocal basis 
    ...data_id should be of length at 2*num_components */
@@ -43,9 +150,9 @@ void fieldio_write_complex_field(scalar_complex *field,
 				 int append,
 				 matrixio_id data_id[])
 {
-     int i, j, k, component, ri_part;
+     int i, j, k, component, ri_part, rdims[3];
 
-     rank = dims[2] == 1 ? (dims[1] == 1 ? 1 : 2) : 3;
+     rank = region_dims(dims, rdims);
 
      if (kvector) {
 	  real s[3]; /* the step size between grid points dotted with k */
@@ -119,11 +226,11 @@ void fieldio_write_complex_field(scalar_complex *field,
 		    if (!append)
 			 data_id[component*2 + ri_part] =
 			      matrixio_create_dataset(file_id, name, NULL,
-						      rank, dims);
+						      rank, rdims);
 		    
-		    matrixio_write_real_data(
-			 data_id[component*2 + ri_part], local_dims, start, 
-			 2 * num_components,
+		    write_region_data(
+			 data_id[component*2 + ri_part], dims, local_dims,
+			 start, 2 * num_components,
 			 ri_part ? &field[component].im
 			 : &field[component].re);
 	       }
@@ -139,11 +246,13 @@ void fieldio_write_real_vals(real *vals,
 			     const char *dataname,
 			     matrixio_id *data_id)
 {
-     rank = dims[2] == 1 ? (dims[1] == 1 ? 1 : 2) : 3;
+     int rdims[3];
+
+     rank = region_dims(dims, rdims);
 
      if (!append || data_id->id < 0)
 	  *data_id = matrixio_create_dataset(file_id, dataname, 
-					     NULL, rank,dims);
+					     NULL, rank,rdims);
      
-     matrixio_write_real_data(*data_id,local_dims,start,1,vals);
+     write_region_data(*data_id,dims,local_dims,start,1,vals);
 }
@@ -916,3 +916,51 @@ real *matrixio_read_real_data(matrixio_id id,
      return NULL;
 #endif
 }
+
+/* Get the rank and dims of the dataset 'name' in the file/group 'id'
+   (or of the first dataset, if name is NULL), e.g. to allocate the
+   data array passed to matrixio_read_real_data.  On input, *rank
+   should be the length of the dims array.  Returns 0 if the dataset
+   could not be found in id, 1 otherwise. */
+int matrixio_read_real_data_dims(matrixio_id id, const char *name,
+				 int *rank, int *dims)
+{
+#if defined(HAVE_HDF5)
+     hid_t space_id, data_id;
+     hsize_t *dims_copy;
+     char *dname;
+     int i, filerank;
+
+     if (name) {
+	  CHK_MALLOC(dname, char, strlen(name) + 1);
+	  strcpy(dname, name);
+     }
+     else {
+	  if (H5Giterate(id.id, "/", NULL, find_dataset, &dname) < 0)
+	       return 0;
+     }
+     SUPPRESS_HDF5_ERRORS(data_id = H5Dopen(id.id, dname));
+     free(dname);
+     if (data_id < 0)
+	  return 0;
+
+     CHECK((space_id = H5Dget_space(data_id)) >= 0,
+	   "error in H5Dget_space");
+     filerank = H5Sget_simple_extent_ndims(space_id);
+     CHECK(*rank >= filerank, "rank in HDF5 file is too big");
+     *rank = filerank;
+
+     CHK_MALLOC(dims_copy, hsize_t, *rank);
+     H5Sget_simple_extent_dims(space_id, dims_copy, NULL);
+     for (i = 0; i < *rank; ++i)
+	  dims[i] = dims_copy[i];
+     free(dims_copy);
+
+     H5Sclose(space_id);
+     H5Dclose(data_id);
+     return 1;
+#else
+     CHECK(0, "no matrixio implementation is linked");
+     return 0;
+#endif
+}
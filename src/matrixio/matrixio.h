@@ -72,6 +72,8 @@ extern real *matrixio_read_real_data(matrixio_id id,
 				     int local_dim0, int local_dim0_start,
 				     int stride,
 				     real *data);
+extern int matrixio_read_real_data_dims(matrixio_id id, const char *name,
+					int *rank, int *dims);
 
 extern void matrixio_write_string_attr(matrixio_id id, const char *name,
 				       const char *val);
@@ -85,6 +87,8 @@ extern real *matrixio_read_data_attr(matrixio_id id, const char *name,
 extern void evectmatrixio_writeall_raw(const char *filename, evectmatrix a);
 extern void evectmatrixio_readall_raw(const char *filename, evectmatrix a);
 
+extern void fieldio_set_region(const int start[3], const int end[3],
+			       int decimation);
 extern void fieldio_write_complex_field(scalar_complex *field,
 					int rank,
 					const int dims[3],
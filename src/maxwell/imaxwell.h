@@ -91,4 +91,32 @@
 #  endif
 #endif
 
+#ifdef HAVE_MPI
+#  define MAXWELL_FFT_COMM(d) \
+     ((d)->fft_comm ? *((MPI_Comm *) (d)->fft_comm) : mpb_comm)
+#endif
+
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+#  define MAXWELL_FFT_BLOCK(d, i) \
+     ((d)->fft_block[i] > 0 ? (ptrdiff_t) (d)->fft_block[i] \
+      : FFTW_MPI_DEFAULT_BLOCK)
+
+/* Internal data for maxwell_set_band_groups.  The processes form a
+   grid of band_groups rows by (# processes / band_groups) columns;
+   the processes in a column have consecutive slabs of the grid, which
+   together form the slab of the column in band_data, and each process
+   in the column does the FFTs of that slab for its own chunk of the
+   bands (with the other processes in its row). */
+typedef struct {
+     MPI_Comm fft_comm; /* our process row, for the FFTs of band_data */
+     MPI_Comm band_comm; /* our process column */
+     int band_rank; /* our rank in band_comm (= the index of our row) */
+     int *local_N, *fft_output_size; /* for each process in the column */
+     int *counts, *displs, *rcounts, *rdispls; /* for MPI_Alltoallv */
+     scalar *buf;
+     int buf_size;
+     evectmatrix Xt; /* our chunk of the bands, in the slab of band_data */
+} maxwell_band_groups;
+#endif
+
 #endif /* IMAXWELL_H */
@@ -21,16 +21,23 @@
 
 #include "imaxwell.h"
 #include "check.h"
+#include "large_malloc.h"
 
 /* This file is has too many #ifdef's...blech. */
 
 #define MIN2(a,b) ((a) < (b) ? (a) : (b))
 #define MAX2(a,b) ((a) > (b) ? (a) : (b))
 
-maxwell_data *create_maxwell_data(int nx, int ny, int nz,
-				  int *local_N, int *N_start, int *alloc_N,
-				  int num_bands,
-				  int max_fft_bands)
+/* create_maxwell_data, with the FFTs (under MPI) distributed over
+   fft_comm (NULL for mpb_comm) in blocks fft_block (0 for default) of
+   the first two dimensions */
+static maxwell_data *create_maxwell_data_comm(int nx, int ny, int nz,
+					      int *local_N, int *N_start,
+					      int *alloc_N,
+					      int num_bands,
+					      int max_fft_bands,
+					      void *fft_comm,
+					      const int fft_block[2])
 {
      int n[3], rank = (nz == 1) ? (ny == 1 ? 1 : 2) : 3;
      maxwell_data *d = 0;
@@ -61,6 +68,18 @@ maxwell_data *create_maxwell_data(int nx, int ny, int nz,
 
      d->current_k[0] = d->current_k[1] = d->current_k[2] = 0.0;
      d->parity = NO_PARITY;
+     d->planewave_cutoff = 0.0;
+     d->grid_planewave = NULL;
+
+     d->fft_comm = fft_comm;
+     d->fft_block[0] = fft_block[0];
+     d->fft_block[1] = fft_block[1];
+     d->band_groups = 1;
+     d->band_data = NULL;
+     d->band_groups_data = NULL;
+     d->precond_eps_tensor = 0;
+     d->eps_precond = NULL;
+     d->mesh_tolerance = 0.0;
 
      d->last_dim_size = d->last_dim = n[rank - 1];
 
@@ -136,9 +155,12 @@ maxwell_data *create_maxwell_data(int nx, int ny, int nz,
 #    endif
 
      fft_data_size = *alloc_N
-	  = FFTW(mpi_local_size_transposed)(rank, np, mpb_comm,
-					    &local_nx, &local_x_start,
-					    &local_ny, &local_y_start);
+	  = FFTW(mpi_local_size_many_transposed)(rank, np, 1,
+						 MAXWELL_FFT_BLOCK(d, 0),
+						 MAXWELL_FFT_BLOCK(d, 1),
+						 MAXWELL_FFT_COMM(d),
+						 &local_nx, &local_x_start,
+						 &local_ny, &local_y_start);
 #    ifndef SCALAR_COMPLEX
      fft_data_size = (*alloc_N *= 2); // convert to # of real scalars
 #    endif
@@ -217,23 +239,17 @@ maxwell_data *create_maxwell_data(int nx, int ny, int nz,
      CHECK(d->plans[0] && d->iplans[0], "FFTW plan creation failed");
 #endif
 
-     CHK_MALLOC(d->eps_inv, symmetric_matrix, d->fft_output_size);
+     CHK_LARGE_MALLOC(d->eps_inv, symmetric_matrix, d->fft_output_size);
      d->mu_inv = NULL;
 
      /* A scratch output array is required because the "ordinary" arrays
 	are not in a cartesian basis (or even a constant basis). */
      fft_data_size *= d->max_fft_bands;
-#if defined(HAVE_FFTW3)
-     d->fft_data = (scalar *) FFTW(malloc)(sizeof(scalar) * 3 * fft_data_size);
-     CHECK(d->fft_data, "out of memory!");
+     CHK_LARGE_MALLOC(d->fft_data, scalar, 3 * fft_data_size);
      d->fft_data2 = d->fft_data; /* works in-place */
-#else
-     CHK_MALLOC(d->fft_data, scalar, 3 * fft_data_size);
-     d->fft_data2 = d->fft_data; /* works in-place */
-#endif
 
-     CHK_MALLOC(d->k_plus_G, k_data, *local_N);
-     CHK_MALLOC(d->k_plus_G_normsqr, real, *local_N);
+     CHK_LARGE_MALLOC(d->k_plus_G, k_data, *local_N);
+     CHK_LARGE_MALLOC(d->k_plus_G_normsqr, real, *local_N);
 
      d->eps_inv_mean = 1.0;
      d->mu_inv_mean = 1.0;
@@ -246,11 +262,42 @@ maxwell_data *create_maxwell_data(int nx, int ny, int nz,
      return d;
 }
 
+maxwell_data *create_maxwell_data(int nx, int ny, int nz,
+				  int *local_N, int *N_start, int *alloc_N,
+				  int num_bands,
+				  int max_fft_bands)
+{
+     int fft_block[2] = {0, 0};
+     return create_maxwell_data_comm(nx, ny, nz, local_N, N_start, alloc_N,
+				     num_bands, max_fft_bands,
+				     NULL, fft_block);
+}
+
 void destroy_maxwell_data(maxwell_data *d)
 {
      if (d) {
 	  int i;
 
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+	  if (d->band_groups_data) {
+	       maxwell_band_groups *g =
+		    (maxwell_band_groups *) d->band_groups_data;
+	       destroy_maxwell_data((maxwell_data *) d->band_data);
+	       MPI_Comm_free(&g->fft_comm);
+	       MPI_Comm_free(&g->band_comm);
+	       free(g->local_N);
+	       free(g->fft_output_size);
+	       free(g->counts);
+	       free(g->displs);
+	       free(g->rcounts);
+	       free(g->rdispls);
+	       free(g->buf);
+	       if (g->Xt.data)
+		    destroy_evectmatrix(g->Xt);
+	       free(g);
+	  }
+#endif
+
 	  for (i = 0; i < d->nplans; ++i) {
 #if defined(HAVE_FFTW3)
 	       FFTW(destroy_plan)((fftplan) (d->plans[i]));
@@ -276,20 +323,219 @@ void destroy_maxwell_data(maxwell_data *d)
 #endif /* HAVE FFTW */
 	  }
 
-	  free(d->eps_inv);
-          if (d->mu_inv) free(d->mu_inv);
-#if defined(HAVE_FFTW3)
-	  FFTW(free)(d->fft_data);
+	  large_free(d->eps_inv);
+	  large_free(d->eps_precond);
+          if (d->mu_inv) large_free(d->mu_inv);
+	  large_free(d->fft_data);
 	  if (d->fft_data2 != d->fft_data)
-	       FFTW(free)(d->fft_data2);
+	       large_free(d->fft_data2);
+	  large_free(d->k_plus_G);
+	  large_free(d->k_plus_G_normsqr);
+	  free(d->grid_planewave);
+
+	  free(d);
+     }
+}
+
+/* update the local_N and fft_output_size of each process in our
+   column of the band-groups grid (see maxwell_set_band_groups) */
+static void maxwell_band_groups_sizes(maxwell_data *d)
+{
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+     maxwell_band_groups *g = (maxwell_band_groups *) d->band_groups_data;
+     maxwell_data *bd = (maxwell_data *) d->band_data;
+     int i, n = 0, n_out = 0;
+
+     MPI_Allgather(&d->local_N, 1, MPI_INT, g->local_N, 1, MPI_INT,
+		   g->band_comm);
+     MPI_Allgather(&d->fft_output_size, 1, MPI_INT,
+		   g->fft_output_size, 1, MPI_INT, g->band_comm);
+     for (i = 0; i < d->band_groups; ++i) {
+	  n += g->local_N[i];
+	  n_out += g->fft_output_size[i];
+     }
+     CHECK(n == bd->local_N && n_out == bd->fft_output_size,
+	   "bug: inconsistent slabs for band groups");
 #else
-	  free(d->fft_data);
+     (void) d;
 #endif
-	  free(d->k_plus_G);
-	  free(d->k_plus_G_normsqr);
+}
 
-	  free(d);
+/* Restrict the planewaves in H (and thus in the eigensolver) to those
+   inside the ellipsoid inscribed in the FFT grid, scaled by cutoff:
+
+        (G1/(nx/2))^2 + (G2/(ny/2))^2 + (G3/(nz/2))^2 < cutoff^2
+
+   in terms of the reciprocal-lattice coordinates G1,G2,G3 of G.  In 3d,
+   cutoff = 1 keeps about half of the planewaves; since the FFTs still
+   use the whole grid, the dropped planewaves (which contribute only
+   the highest spatial frequencies) are zero when transforming to
+   position space and are discarded when transforming back.  cutoff
+   <= 0 (the default) keeps all of the planewaves.
+
+   This must be called before update_maxwell_data_k, and the returned
+   N, local_N, N_start, and alloc_N (as for create_maxwell_data)
+   should be used to create the eigenvector matrices.  Note that
+   d->N remains nx*ny*nz, the number of points in the FFT grid. */
+void maxwell_set_planewave_cutoff(maxwell_data *d, real cutoff,
+				  int *N, int *local_N, int *N_start,
+				  int *alloc_N)
+{
+     int nx = d->nx, ny = d->ny, nz = d->nz;
+     int cx = MAX2(1,d->nx/2), cy = MAX2(1,d->ny/2), cz = MAX2(1,d->nz/2);
+     int x, y, z, ij = 0, n = 0, n_local;
+
+     free(d->grid_planewave);
+     d->grid_planewave = NULL;
+     n_local = d->local_nx * ny * nz;
+
+     if (cutoff > 0) {
+	  CHK_MALLOC(d->grid_planewave, int, n_local);
+	  for (x = d->local_x_start; x < d->local_x_start + d->local_nx; ++x) {
+	       int kxi = (x >= cx) ? (x - nx) : x;
+	       for (y = 0; y < ny; ++y) {
+		    int kyi = (y >= cy) ? (y - ny) : y;
+		    for (z = 0; z < nz; ++z, ++ij) {
+			 int kzi = (z >= cz) ? (z - nz) : z;
+			 real gx = kxi / (0.5 * nx), gy = kyi / (0.5 * ny);
+			 real gz = kzi / (0.5 * nz);
+			 if (gx*gx + gy*gy + gz*gz < cutoff * cutoff)
+			      d->grid_planewave[ij] = n++;
+			 else
+			      d->grid_planewave[ij] = -1;
+		    }
+	       }
+	  }
+	  if (n == n_local) { /* no planewaves were dropped */
+	       free(d->grid_planewave);
+	       d->grid_planewave = NULL;
+	  }
      }
+     else
+	  n = n_local;
+
+     d->planewave_cutoff = cutoff > 0 ? cutoff : 0.0;
+
+     *local_N = *alloc_N = n;
+#ifdef HAVE_MPI
+     MPI_Allreduce(&n, N, 1, MPI_INT, MPI_SUM, MAXWELL_FFT_COMM(d));
+     MPI_Scan(&n, N_start, 1, MPI_INT, MPI_SUM, MAXWELL_FFT_COMM(d));
+     *N_start -= n;
+#else
+     *N = n;
+     *N_start = 0;
+#endif
+
+     d->local_N = *local_N;
+     d->N_start = *N_start;
+     d->alloc_N = *alloc_N;
+
+     large_free(d->k_plus_G);
+     large_free(d->k_plus_G_normsqr);
+     CHK_LARGE_MALLOC(d->k_plus_G, k_data, MAX2(1, n));
+     CHK_LARGE_MALLOC(d->k_plus_G_normsqr, real, MAX2(1, n));
+
+     if (d->band_data) {
+	  int bN, blocal_N, bN_start, balloc_N;
+	  maxwell_set_planewave_cutoff((maxwell_data *) d->band_data, cutoff,
+				       &bN, &blocal_N, &bN_start, &balloc_N);
+	  maxwell_band_groups_sizes(d);
+     }
+}
+
+/* Divide the FFTs (and the multiplications by epsilon) in the Maxwell
+   operator and preconditioner among band_groups groups ("rows") of
+   processes, each of which handles a chunk of the bands.  The
+   processes are arranged in a grid of band_groups rows by P /
+   band_groups columns, where P is the number of processes; the
+   slabs of the band_groups consecutive processes in each column are
+   combined into one thicker slab, and the FFT for each chunk of bands
+   is distributed (with FFTW's slab decomposition) over the P /
+   band_groups processes of a row.  Each process transposes its
+   portion of the bands with the other processes in its column before
+   and after the FFTs.
+
+   The eigenvectors (and everything else outside of these operators)
+   are distributed exactly as before, so that the dot products in the
+   eigensolver are still summed over all of the processes.  This is
+   only supported under MPI with FFTW3, and requires band_groups to
+   divide the number of processes.
+
+   Like maxwell_set_planewave_cutoff, this must be called before
+   update_maxwell_data_k and set_maxwell_dielectric.  band_data has
+   its own copy of the (thicker slab of the) dielectric function;
+   this is updated by set_maxwell_dielectric and set_maxwell_mu, but
+   if you modify d->eps_inv or d->mu_inv directly you must call
+   maxwell_update_band_groups_eps afterwards. */
+void maxwell_set_band_groups(maxwell_data *d, int band_groups)
+{
+     CHECK(band_groups > 0, "band_groups must be positive");
+     CHECK(d->band_groups == 1, "band groups are already set");
+     if (band_groups == 1)
+	  return;
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+     {
+	  maxwell_band_groups *g;
+	  maxwell_data *bd;
+	  int np, rank, n1, fft_block[2];
+	  int blocal_N, bN_start, balloc_N;
+
+	  MPI_Comm_size(mpb_comm, &np);
+	  MPI_Comm_rank(mpb_comm, &rank);
+	  CHECK(np % band_groups == 0,
+		"band_groups must divide the number of processes");
+	  CHECK(d->fft_comm == NULL, "band_data cannot have band groups");
+
+	  CHK_MALLOC(g, maxwell_band_groups, 1);
+	  /* the processes rank/band_groups form a column, and rank %
+	     band_groups gives the row: */
+	  MPI_Comm_split(mpb_comm, rank / band_groups, rank, &g->band_comm);
+	  MPI_Comm_split(mpb_comm, rank % band_groups, rank, &g->fft_comm);
+	  g->band_rank = rank % band_groups;
+	  CHK_MALLOC(g->local_N, int, band_groups);
+	  CHK_MALLOC(g->fft_output_size, int, band_groups);
+	  CHK_MALLOC(g->counts, int, band_groups);
+	  CHK_MALLOC(g->displs, int, band_groups);
+	  CHK_MALLOC(g->rcounts, int, band_groups);
+	  CHK_MALLOC(g->rdispls, int, band_groups);
+	  g->buf = NULL;
+	  g->buf_size = 0;
+	  g->Xt.data = NULL;
+
+	  /* The default blocks of d are ceil(n/np) (see
+	     create_maxwell_data); the blocks of the rows are band_groups
+	     times larger, so that each is the union of the slabs in a
+	     column.  (In the real, 2d case, FFTW's second dimension is
+	     the complex ny/2+1.) */
+	  n1 = d->ny;
+#  ifndef SCALAR_COMPLEX
+	  if (d->nz == 1)
+	       n1 = d->ny / 2 + 1;
+#  endif
+	  fft_block[0] = band_groups * ((d->nx + np - 1) / np);
+	  fft_block[1] = band_groups * ((n1 + np - 1) / np);
+
+	  bd = create_maxwell_data_comm(d->nx, d->ny, d->nz,
+					&blocal_N, &bN_start, &balloc_N,
+					(d->num_bands + band_groups - 1)
+					/ band_groups,
+					d->max_fft_bands,
+					&g->fft_comm, fft_block);
+	  d->band_groups = band_groups;
+	  d->band_data = bd;
+	  d->band_groups_data = g;
+
+	  if (d->planewave_cutoff > 0) {
+	       int bN;
+	       maxwell_set_planewave_cutoff(bd, d->planewave_cutoff,
+					    &bN, &blocal_N, &bN_start,
+					    &balloc_N);
+	  }
+	  maxwell_band_groups_sizes(d);
+     }
+#else
+     CHECK(0, "band_groups > 1 requires MPI and FFTW3");
+#endif
 }
 
 void maxwell_set_num_bands(maxwell_data *d, int num_bands)
@@ -385,7 +631,9 @@ void maxwell_set_planewave(maxwell_data *d, evectmatrix H, int band,
         scalar Hx, Hy, Hz;
         k_data k;
 
-        i = ((x - d->local_x_start) * d->ny + y) * d->nz + z;
+        i = MAXWELL_PLANEWAVE(d, ((x - d->local_x_start) * d->ny + y)
+			      * d->nz + z);
+        CHECK(i >= 0, "planewave is outside of the planewave cutoff");
         k = d->k_plus_G[i];
 
         compute_cross(&kx, &ky, &kz, /* unit vector in direction of k+G */
@@ -422,9 +670,9 @@ void update_maxwell_data_k(maxwell_data *d, real k[3],
 {
      int nx = d->nx, ny = d->ny, nz = d->nz;
      int cx = MAX2(1,d->nx/2), cy = MAX2(1,d->ny/2), cz = MAX2(1,d->nz/2);
-     k_data *kpG = d->k_plus_G;
-     real *kpGn2 = d->k_plus_G_normsqr;
-     int x, y, z;
+     k_data *kpG;
+     real *kpGn2;
+     int x, y, z, ij = 0;
      real kx, ky, kz;
 
      kx = G1[0]*k[0] + G2[0]*k[1] + G3[0]*k[2];
@@ -444,10 +692,16 @@ void update_maxwell_data_k(maxwell_data *d, real k[3],
 	  int kxi = (x >= cx) ? (x - nx) : x;
 	  for (y = 0; y < ny; ++y) {
 	       int kyi = (y >= cy) ? (y - ny) : y;
-	       for (z = 0; z < nz; ++z, kpG++, kpGn2++) {
+	       for (z = 0; z < nz; ++z, ++ij) {
 		    int kzi = (z >= cz) ? (z - nz) : z;
+		    int ipw = MAXWELL_PLANEWAVE(d, ij);
 		    real kpGx, kpGy, kpGz, a, b, c, leninv;
 
+		    if (ipw < 0)
+			 continue; /* outside of the planewave cutoff */
+		    kpG = d->k_plus_G + ipw;
+		    kpGn2 = d->k_plus_G_normsqr + ipw;
+
 		    /* Compute k+G (noting that G is negative because
 		       of the choice of sign in the FFTW Fourier transform): */
 		    kpGx = kx - (G1[0]*kxi + G2[0]*kyi + G3[0]*kzi);
@@ -519,6 +773,56 @@ void update_maxwell_data_k(maxwell_data *d, real k[3],
 	       }
 	  }
      }
+
+     if (d->band_data)
+	  update_maxwell_data_k((maxwell_data *) d->band_data, k, G1, G2, G3);
+}
+
+/* Copy eps_inv and mu_inv to band_data, if any (see
+   maxwell_set_band_groups). */
+void maxwell_update_band_groups_eps(maxwell_data *d)
+{
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+     maxwell_band_groups *g = (maxwell_band_groups *) d->band_groups_data;
+     maxwell_data *bd = (maxwell_data *) d->band_data;
+     MPI_Datatype t;
+     int i;
+
+     if (!g)
+	  return;
+
+     /* the processes in a column have consecutive slabs of y (in the
+	transposed output of the FFT), so the epsilon data of band_data
+	is just the concatenation of theirs: */
+     for (i = 0; i < d->band_groups; ++i)
+	  g->displs[i] = i ? g->displs[i-1] + g->fft_output_size[i-1] : 0;
+     MPI_Type_contiguous(sizeof(symmetric_matrix) / sizeof(real),
+			 SCALAR_MPI_TYPE, &t);
+     MPI_Type_commit(&t);
+     MPI_Allgatherv(d->eps_inv, d->fft_output_size, t,
+		    bd->eps_inv, g->fft_output_size, g->displs, t,
+		    g->band_comm);
+     if (d->mu_inv) {
+	  if (!bd->mu_inv)
+	       CHK_LARGE_MALLOC(bd->mu_inv, symmetric_matrix,
+				bd->fft_output_size);
+	  MPI_Allgatherv(d->mu_inv, d->fft_output_size, t,
+			 bd->mu_inv, g->fft_output_size, g->displs, t,
+			 g->band_comm);
+     }
+     else if (bd->mu_inv) {
+	  large_free(bd->mu_inv);
+	  bd->mu_inv = NULL;
+     }
+     MPI_Type_free(&t);
+     large_free(bd->eps_precond);
+     bd->eps_precond = NULL;
+
+     bd->eps_inv_mean = d->eps_inv_mean;
+     bd->mu_inv_mean = d->mu_inv_mean;
+#else
+     (void) d;
+#endif
 }
 
 void set_maxwell_data_parity(maxwell_data *d, int parity)
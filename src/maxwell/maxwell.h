@@ -92,7 +92,8 @@ typedef struct {
      int last_dim, last_dim_size, other_dims;
 
      int num_bands;
-     int N, local_N, N_start, alloc_N;
+     int N, local_N, N_start, alloc_N; /* N = nx*ny*nz, while local_N
+					  etc. are the planewaves in H */
 
      int fft_output_size;
 
@@ -110,6 +111,31 @@ typedef struct {
      k_data *k_plus_G;
      real *k_plus_G_normsqr;
 
+     real planewave_cutoff; /* 0 if all planewaves in the grid are used */
+     int *grid_planewave; /* if non-NULL, index in H of each local grid
+			     point, or -1 if outside the cutoff */
+
+     void *fft_comm; /* (MPI_Comm *) for the FFTs, or NULL for mpb_comm */
+     int fft_block[2]; /* MPI block sizes of the first two FFT dimensions,
+			  or 0 for FFTW's default */
+
+     int band_groups; /* number of process rows among which the FFTs
+			 of the bands are divided (MPI only), or 1 */
+     void *band_data; /* if band_groups > 1, maxwell_data (with the slab
+			 of our process row) used for our share of bands */
+     void *band_groups_data; /* internal data for band_groups > 1 */
+
+     int precond_eps_tensor; /* non-zero for maxwell_preconditioner2 to
+				multiply by the inverse of the full local
+				eps_inv tensor, rather than of its trace */
+     symmetric_matrix *eps_precond; /* the inverse of each eps_inv, computed
+				       when first needed for
+				       precond_eps_tensor, or NULL */
+
+     real mesh_tolerance; /* if > 0, set_maxwell_dielectric averages each
+			     voxel adaptively to this relative tolerance,
+			     rather than over the uniform mesh_size mesh */
+
      symmetric_matrix *eps_inv;
      real eps_inv_mean;
      symmetric_matrix *mu_inv;
@@ -123,6 +149,21 @@ extern maxwell_data *create_maxwell_data(int nx, int ny, int nz,
 					 int num_fft_bands);
 extern void destroy_maxwell_data(maxwell_data *d);
 
+extern void maxwell_set_planewave_cutoff(maxwell_data *d, real cutoff,
+					 int *N, int *local_N, int *N_start,
+					 int *alloc_N);
+
+extern void maxwell_set_band_groups(maxwell_data *d, int band_groups);
+extern void maxwell_update_band_groups_eps(maxwell_data *d);
+extern evectmatrix maxwell_band_groups_begin(maxwell_data *d, evectmatrix X);
+extern void maxwell_band_groups_end(maxwell_data *d, evectmatrix Xt,
+				    evectmatrix X);
+
+/* index in H (and in k_plus_G) of the planewave at local grid index ij,
+   or -1 if it is outside the planewave cutoff */
+#define MAXWELL_PLANEWAVE(d, ij) \
+     ((d)->grid_planewave ? (d)->grid_planewave[ij] : (ij))
+
 extern void maxwell_set_num_bands(maxwell_data *d, int num_bands);
 
 extern void maxwell_dominant_planewave(maxwell_data *d, evectmatrix H, int band, double kdom[3]);
@@ -229,6 +270,33 @@ extern void maxwell_zero_k_constraint(evectmatrix X, void *data);
 extern double *maxwell_zparity(evectmatrix X, maxwell_data *d);
 extern double *maxwell_yparity(evectmatrix X, maxwell_data *d);
 
+typedef struct {
+     maxwell_data *d;
+     int num_ops;
+     int *M;  /* W^{-T} (acting on reciprocal coords), 9 per operation */
+     real *Wc;  /* det(W) W in cartesian coords, 9 per operation */
+     real *w;  /* translations (lattice basis), 3 per operation */
+     scalar_complex *chi;  /* characters of the irrep */
+     real kappa[3];  /* the current k in the reciprocal basis */
+     int *g0;  /* W k - k (reciprocal basis) at the current k, 3 per op */
+     char *in_grid;  /* whether the orbit of each planewave is in the grid */
+     real k_set[3];  /* d->current_k when the above were computed */
+     int have_k;
+     real R[3][3];  /* lattice vectors */
+     real norm;  /* dimension of irrep / number of operations */
+     scalar *Y;  /* scratch array for projected fields */
+     int Y_size;
+} maxwell_irrep_data;
+
+extern maxwell_irrep_data *create_maxwell_irrep_data(maxwell_data *d,
+						     real R[3][3], int num_ops,
+						     const real *W,
+						     const real *w,
+						     const scalar_complex *chi);
+extern void destroy_maxwell_irrep_data(maxwell_irrep_data *id);
+extern void maxwell_irrep_set_k(maxwell_irrep_data *id);
+extern void maxwell_irrep_constraint(evectmatrix X, void *data);
+
 typedef struct {
      maxwell_data *d;
      real target_frequency;
@@ -253,11 +321,31 @@ extern void maxwell_target_preconditioner2(evectmatrix Xin, evectmatrix Xout,
 					   evectmatrix Y, real *eigenvals,
 					   sqmatrix YtY);
 
+typedef struct {
+     maxwell_data *d;
+     int nbins;
+     real fmin, fmax, broadening; /* bins of width (fmax-fmin)/nbins */
+     real *dos, *pdos; /* nbins each */
+     real *ldos; /* nbins x fft_output_size, or NULL if not spatial */
+     real *mask; /* fft_output_size, 1 where the DOS is projected, or NULL */
+} maxwell_ldos_data;
+
+extern maxwell_ldos_data *create_maxwell_ldos_data(maxwell_data *d,
+						   int nbins,
+						   real fmin, real fmax,
+						   real broadening,
+						   int spatial);
+extern void destroy_maxwell_ldos_data(maxwell_ldos_data *d);
+extern void maxwell_accumulate_ldos(maxwell_ldos_data *d, evectmatrix H,
+				    evectmatrix W, const real *freqs,
+				    real vol, real weight);
+
 extern void spherical_quadrature_points(real *x, real *y, real *z,
 					real *weight, int num_sq_pts);
 
 extern int check_maxwell_dielectric(maxwell_data *d,
 				    int negative_epsilon_okp);
+extern int maxwell_dielectric_inversion_symmetric(maxwell_data *d, real tol);
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -82,40 +82,42 @@ void maxwell_zparity_constraint(evectmatrix X, void *data)
 	  nz = d->last_dim;
      }
      else {  /* common case (2d system): even/odd == TE/TM */
-	  nxy = d->other_dims * d->last_dim;
+	  nxy = X.localN;
 	  if (zparity == +1)
 	       for (i = 0; i < nxy; ++i) 
 		    for (b = 0; b < X.p; ++b) {
-			 ASSIGN_ZERO(X.data[(i * X.c + 1) * X.p + b]);
+			 ASSIGN_ZERO(X.data[(i * X.c + 1) * X.ld + b]);
 		    }
 	  else if (zparity == -1)
 	       for (i = 0; i < nxy; ++i) 
 		    for (b = 0; b < X.p; ++b) {
-			 ASSIGN_ZERO(X.data[(i * X.c) * X.p + b]);
+			 ASSIGN_ZERO(X.data[(i * X.c) * X.ld + b]);
 		    }
 	  return;
      }
 
      for (i = 0; i < nxy; ++i) {
 	  for (j = 0; 2*j <= nz; ++j) {
-	       int ij = i * nz + j; 
-	       int ij2 = i * nz + (j > 0 ? nz - j : 0);
+	       int ij = MAXWELL_PLANEWAVE(d, i * nz + j); 
+	       int ij2 = MAXWELL_PLANEWAVE(d, i * nz + (j > 0 ? nz - j : 0));
+	       if (ij < 0)
+		    continue; /* (mirror image is also outside the cutoff) */
 	       for (b = 0; b < X.p; ++b) {
 		    scalar u,v, u2,v2;
-		    u = X.data[(ij * 2) * X.p + b];
-		    v = X.data[(ij * 2 + 1) * X.p + b];
-		    u2 = X.data[(ij2 * 2) * X.p + b];
-		    v2 = X.data[(ij2 * 2 + 1) * X.p + b];
-		    ASSIGN_SCALAR(X.data[(ij * 2) * X.p + b],
+		    u = X.data[(ij * 2) * X.ld + b];
+		    v = X.data[(ij * 2 + 1) * X.ld + b];
+		    u2 = X.data[(ij2 * 2) * X.ld + b];
+		    v2 = X.data[(ij2 * 2 + 1) * X.ld + b];
+		    ASSIGN_SCALAR(X.data[(ij * 2) * X.ld + b],
 				  0.5*(SCALAR_RE(u) + zparity*SCALAR_RE(u2)),
 				  0.5*(SCALAR_IM(u) + zparity*SCALAR_IM(u2)));
-		    ASSIGN_SCALAR(X.data[(ij * 2 + 1) * X.p + b],
+		    ASSIGN_SCALAR(X.data[(ij * 2 + 1) * X.ld + b],
 				  0.5*(SCALAR_RE(v) - zparity*SCALAR_RE(v2)),
 				  0.5*(SCALAR_IM(v) - zparity*SCALAR_IM(v2)));
-		    ASSIGN_SCALAR(X.data[(ij2 * 2) * X.p + b],
+		    ASSIGN_SCALAR(X.data[(ij2 * 2) * X.ld + b],
 				  0.5*(SCALAR_RE(u2) + zparity*SCALAR_RE(u)),
 				  0.5*(SCALAR_IM(u2) + zparity*SCALAR_IM(u)));
-		    ASSIGN_SCALAR(X.data[(ij2 * 2 + 1) * X.p + b],
+		    ASSIGN_SCALAR(X.data[(ij2 * 2 + 1) * X.ld + b],
 				  0.5*(SCALAR_RE(v2) - zparity*SCALAR_RE(v)),
 				  0.5*(SCALAR_IM(v2) - zparity*SCALAR_IM(v)));
 	       }
@@ -156,14 +158,16 @@ double *maxwell_zparity(evectmatrix X, maxwell_data *d)
 
      for (i = 0; i < nxy; ++i)
 	  for (j = 0; 2*j <= nz; ++j) {
-	       int ij = i * nz + j; 
-	       int ij2 = i * nz + (j > 0 ? nz - j : 0);
+	       int ij = MAXWELL_PLANEWAVE(d, i * nz + j); 
+	       int ij2 = MAXWELL_PLANEWAVE(d, i * nz + (j > 0 ? nz - j : 0));
+	       if (ij < 0)
+		    continue; /* (mirror image is also outside the cutoff) */
 	       for (b = 0; b < X.p; ++b) {
 		    scalar u,v, u2,v2;
-		    u = X.data[(ij * 2) * X.p + b];
-		    v = X.data[(ij * 2 + 1) * X.p + b];
-		    u2 = X.data[(ij2 * 2) * X.p + b];
-		    v2 = X.data[(ij2 * 2 + 1) * X.p + b];
+		    u = X.data[(ij * 2) * X.ld + b];
+		    v = X.data[(ij * 2 + 1) * X.ld + b];
+		    u2 = X.data[(ij2 * 2) * X.ld + b];
+		    v2 = X.data[(ij2 * 2 + 1) * X.ld + b];
 		    zp_scratch[b] += (ij == ij2 ? 1.0 : 2.0) *
 			 (SCALAR_RE(u) * SCALAR_RE(u2) +
 			  SCALAR_IM(u) * SCALAR_IM(u2) -
@@ -219,24 +223,26 @@ void maxwell_yparity_constraint(evectmatrix X, void *data)
 	       int ij = i * ny + j; 
 	       int ij2 = i * ny + (j > 0 ? ny - j : 0);
 	       for (k = 0; k < nz; ++k) {
-		    int ijk = ij * nz + k;
-		    int ijk2 = ij2 * nz + k;
+		    int ijk = MAXWELL_PLANEWAVE(d, ij * nz + k);
+		    int ijk2 = MAXWELL_PLANEWAVE(d, ij2 * nz + k);
+		    if (ijk < 0)
+			 continue; /* (mirror image is also outside cutoff) */
 		    for (b = 0; b < X.p; ++b) {
 			 scalar u,v, u2,v2;
-			 u = X.data[(ijk * 2) * X.p + b];
-			 v = X.data[(ijk * 2 + 1) * X.p + b];
-			 u2 = X.data[(ijk2 * 2) * X.p + b];
-			 v2 = X.data[(ijk2 * 2 + 1) * X.p + b];
-			 ASSIGN_SCALAR(X.data[(ijk * 2) * X.p + b],
+			 u = X.data[(ijk * 2) * X.ld + b];
+			 v = X.data[(ijk * 2 + 1) * X.ld + b];
+			 u2 = X.data[(ijk2 * 2) * X.ld + b];
+			 v2 = X.data[(ijk2 * 2 + 1) * X.ld + b];
+			 ASSIGN_SCALAR(X.data[(ijk * 2) * X.ld + b],
 				  0.5*(SCALAR_RE(u) - yparity*SCALAR_RE(u2)),
 				  0.5*(SCALAR_IM(u) - yparity*SCALAR_IM(u2)));
-			 ASSIGN_SCALAR(X.data[(ijk * 2 + 1) * X.p + b],
+			 ASSIGN_SCALAR(X.data[(ijk * 2 + 1) * X.ld + b],
 				  0.5*(SCALAR_RE(v) + yparity*SCALAR_RE(v2)),
 				  0.5*(SCALAR_IM(v) + yparity*SCALAR_IM(v2)));
-			 ASSIGN_SCALAR(X.data[(ijk2 * 2) * X.p + b],
+			 ASSIGN_SCALAR(X.data[(ijk2 * 2) * X.ld + b],
 				  0.5*(SCALAR_RE(u2) - yparity*SCALAR_RE(u)),
 				  0.5*(SCALAR_IM(u2) - yparity*SCALAR_IM(u)));
-			 ASSIGN_SCALAR(X.data[(ijk2 * 2 + 1) * X.p + b],
+			 ASSIGN_SCALAR(X.data[(ijk2 * 2 + 1) * X.ld + b],
 				  0.5*(SCALAR_RE(v2) + yparity*SCALAR_RE(v)),
 				  0.5*(SCALAR_IM(v2) + yparity*SCALAR_IM(v)));
 		    }
@@ -276,14 +282,16 @@ double *maxwell_yparity(evectmatrix X, maxwell_data *d)
 	       int ij = i * ny + j; 
 	       int ij2 = i * ny + (j > 0 ? ny - j : 0);
 	       for (k = 0; k < nz; ++k) {
-		    int ijk = ij * nz + k;
-		    int ijk2 = ij2 * nz + k;
+		    int ijk = MAXWELL_PLANEWAVE(d, ij * nz + k);
+		    int ijk2 = MAXWELL_PLANEWAVE(d, ij2 * nz + k);
+		    if (ijk < 0)
+			 continue; /* (mirror image is also outside cutoff) */
 		    for (b = 0; b < X.p; ++b) {
 			 scalar u,v, u2,v2;
-			 u = X.data[(ijk * 2) * X.p + b];
-			 v = X.data[(ijk * 2 + 1) * X.p + b];
-			 u2 = X.data[(ijk2 * 2) * X.p + b];
-			 v2 = X.data[(ijk2 * 2 + 1) * X.p + b];
+			 u = X.data[(ijk * 2) * X.ld + b];
+			 v = X.data[(ijk * 2 + 1) * X.ld + b];
+			 u2 = X.data[(ijk2 * 2) * X.ld + b];
+			 v2 = X.data[(ijk2 * 2 + 1) * X.ld + b];
 			 yp_scratch[b] += (ijk == ijk2 ? 1.0 : 2.0) *
 			      (SCALAR_RE(v) * SCALAR_RE(v2) +
 			       SCALAR_IM(v) * SCALAR_IM(v2) -
@@ -313,6 +321,359 @@ double *maxwell_yparity(evectmatrix X, maxwell_data *d)
 
 /**************************************************************************/
 
+/* Generalizing the mirror parities above, if the structure is
+   symmetric under a point group (e.g. C4v, C6v, or Oh), then the
+   states at k can be classified by the irreducible representations
+   of the little group of k.  Given the operations {W|w} of the group
+   (W a rotation and w a translation, both in the lattice basis, just
+   as in mpb/transform.c) and the characters chi(g) of an irrep, the
+   operator
+
+        P = (dim / |group|) sum_g conj(chi(g)) {W|w}
+
+   projects onto that irrep.  Like the parity projections, P commutes
+   with the Maxwell operator, so we can use it as a constraint to
+   solve for only one irrep at a time.
+
+   Since H is stored in the planewave basis, the operations are applied
+   directly in G-space: {W|w} maps the planewave k+G to W(k+G) (which is
+   some k+G' if W is in the little group of k), rotates the polarization
+   by det(W) W (H is a pseudovector), and multiplies by the phase
+   exp(-i (k+G').w).  This requires no interpolation, but needs all
+   of the planewaves on a single process, and a grid that is
+   compatible with the symmetry (e.g. nx == ny for a C4 rotation
+   about z).  Near the edge of the grid, some planewaves are mapped
+   outside of the grid (or of the planewave cutoff); their orbits are
+   dropped (these are only the highest-frequency components), so that
+   P remains a projection. */
+
+#define TWOPI 6.2831853071795864769252867665590057683943388
+#define MAX2(a,b) ((a) > (b) ? (a) : (b))
+
+static int round_int(double x)
+{
+     double f = floor(x + 0.5);
+     return (int) f;
+}
+
+static double invert3x3(double Ainv[3][3], double A[3][3])
+{
+     double det;
+     int i, j;
+
+     Ainv[0][0] = A[1][1]*A[2][2] - A[1][2]*A[2][1];
+     Ainv[0][1] = A[0][2]*A[2][1] - A[0][1]*A[2][2];
+     Ainv[0][2] = A[0][1]*A[1][2] - A[0][2]*A[1][1];
+     Ainv[1][0] = A[1][2]*A[2][0] - A[1][0]*A[2][2];
+     Ainv[1][1] = A[0][0]*A[2][2] - A[0][2]*A[2][0];
+     Ainv[1][2] = A[0][2]*A[1][0] - A[0][0]*A[1][2];
+     Ainv[2][0] = A[1][0]*A[2][1] - A[1][1]*A[2][0];
+     Ainv[2][1] = A[0][1]*A[2][0] - A[0][0]*A[2][1];
+     Ainv[2][2] = A[0][0]*A[1][1] - A[0][1]*A[1][0];
+     det = A[0][0]*Ainv[0][0] + A[0][1]*Ainv[1][0] + A[0][2]*Ainv[2][0];
+     CHECK(det != 0.0, "singular symmetry operation");
+     for (i = 0; i < 3; ++i)
+	  for (j = 0; j < 3; ++j)
+	       Ainv[i][j] /= det;
+     return det;
+}
+
+/* Create the data for maxwell_irrep_constraint.  R[i] is the i-th
+   lattice vector (cartesian), and the num_ops operations are given by
+   W (9*num_ops entries, each a row-major 3x3 matrix in the lattice
+   basis), w (3*num_ops entries, in the lattice basis), and the
+   corresponding characters chi of the irrep. */
+maxwell_irrep_data *create_maxwell_irrep_data(maxwell_data *d,
+					      real R[3][3], int num_ops,
+					      const real *W, const real *w,
+					      const scalar_complex *chi)
+{
+     maxwell_irrep_data *id;
+     double Rm[3][3], Rinv[3][3];
+     int iop, a, b, c, dim_found = 0;
+     int n[3];
+
+     CHECK(d, "null maxwell data pointer!");
+     CHECK(num_ops > 0, "no symmetry operations for irrep projection");
+#ifndef SCALAR_COMPLEX
+     CHECK(0, "irrep projection is not yet implemented for mpbi");
+#endif
+
+     n[0] = d->nx; n[1] = d->ny; n[2] = d->nz;
+
+     CHK_MALLOC(id, maxwell_irrep_data, 1);
+     id->d = d;
+     id->num_ops = num_ops;
+     id->have_k = 0;
+     CHK_MALLOC(id->M, int, 9 * num_ops);
+     CHK_MALLOC(id->Wc, real, 9 * num_ops);
+     CHK_MALLOC(id->w, real, 3 * num_ops);
+     CHK_MALLOC(id->chi, scalar_complex, num_ops);
+     CHK_MALLOC(id->g0, int, 3 * num_ops);
+     CHK_MALLOC(id->in_grid, char, d->local_N);
+     id->Y_size = d->local_N * 2 * d->num_bands;
+     CHK_MALLOC(id->Y, scalar, id->Y_size);
+
+     for (a = 0; a < 3; ++a)
+	  for (b = 0; b < 3; ++b) {
+	       id->R[a][b] = R[a][b];
+	       Rm[a][b] = R[b][a]; /* columns of Rm are the lattice vectors */
+	  }
+     invert3x3(Rinv, Rm);
+
+     id->norm = 1.0 / num_ops;
+     for (iop = 0; iop < num_ops; ++iop) {
+	  double Wl[3][3], Winv[3][3], RW[3][3], detW;
+	  int *M = id->M + 9*iop, is_identity = 1;
+
+	  for (a = 0; a < 3; ++a)
+	       for (b = 0; b < 3; ++b)
+		    Wl[a][b] = W[9*iop + 3*a + b];
+	  detW = 1.0 / invert3x3(Winv, Wl);
+	  CHECK(fabs(fabs(detW) - 1.0) < 1e-8,
+		"symmetry operations must have |det(W)| = 1");
+
+	  /* W^{-T}, the action of W on reciprocal-lattice coordinates,
+	     must be an integer matrix for a lattice symmetry: */
+	  for (a = 0; a < 3; ++a)
+	       for (b = 0; b < 3; ++b) {
+		    M[3*a + b] = round_int(Winv[b][a]);
+		    CHECK(fabs(Winv[b][a] - M[3*a + b]) < 1e-8,
+			  "symmetry operation is not a lattice symmetry");
+		    if (a != b && M[3*a + b] != 0)
+			 CHECK(n[a] == n[b], "grid is not compatible with "
+			       "the symmetry operation");
+		    is_identity = is_identity && M[3*a + b] == (a == b);
+	       }
+
+	  /* cartesian rotation R W R^{-1}, times det(W) for the
+	     pseudovector H: */
+	  for (a = 0; a < 3; ++a)
+	       for (b = 0; b < 3; ++b) {
+		    RW[a][b] = 0;
+		    for (c = 0; c < 3; ++c)
+			 RW[a][b] += Rm[a][c] * Wl[c][b];
+	       }
+	  for (a = 0; a < 3; ++a)
+	       for (b = 0; b < 3; ++b) {
+		    double s = 0;
+		    for (c = 0; c < 3; ++c)
+			 s += RW[a][c] * Rinv[c][b];
+		    id->Wc[9*iop + 3*a + b] = detW * s;
+	       }
+
+	  for (a = 0; a < 3; ++a) {
+	       id->w[3*iop + a] = w[3*iop + a];
+	       is_identity = is_identity &&
+		    fabs(w[3*iop + a] - floor(w[3*iop + a] + 0.5)) < 1e-8;
+	  }
+	  id->chi[iop] = chi[iop];
+
+	  /* the character of the identity is the dimension of the irrep: */
+	  if (is_identity && !dim_found) {
+	       id->norm = CSCALAR_RE(chi[iop]) / num_ops;
+	       dim_found = 1;
+	  }
+     }
+
+     return id;
+}
+
+void destroy_maxwell_irrep_data(maxwell_irrep_data *id)
+{
+     if (id) {
+	  free(id->Y);
+	  free(id->in_grid);
+	  free(id->g0);
+	  free(id->chi);
+	  free(id->w);
+	  free(id->Wc);
+	  free(id->M);
+	  free(id);
+     }
+}
+
+/* Return the index (in H) of the planewave that the planewave with
+   (signed) reciprocal-lattice coordinates n is mapped to by the
+   operation with reciprocal-space action M and (W k - k) given by g0,
+   storing its coordinates in n2, or -1 if it lies outside of the grid
+   or of the planewave cutoff. */
+static int irrep_map_planewave(const maxwell_data *d,
+			       const int *M, const int g0[3],
+			       const int n[3], int n2[3])
+{
+     int a, i[3], nn[3];
+
+     nn[0] = d->nx; nn[1] = d->ny; nn[2] = d->nz;
+     for (a = 0; a < 3; ++a) {
+	  int c = MAX2(1, nn[a]/2);
+	  n2[a] = g0[a] + M[3*a] * n[0] + M[3*a+1] * n[1] + M[3*a+2] * n[2];
+	  i[a] = n2[a] < 0 ? n2[a] + nn[a] : n2[a];
+	  if (i[a] < 0 || i[a] >= nn[a] || (i[a] >= c) != (n2[a] < 0))
+	       return -1;
+     }
+     return MAXWELL_PLANEWAVE(d, (i[0] * nn[1] + i[1]) * nn[2] + i[2]);
+}
+
+/* Compute the data of the irrep projection that depend on the k point
+   (which must be in the little group of the operations); this must be
+   called after each update_maxwell_data_k. */
+void maxwell_irrep_set_k(maxwell_irrep_data *id)
+{
+     maxwell_data *d;
+     int nx, ny, nz, cx, cy, cz;
+     int iop, i, ig, a, n[3], n2[3];
+
+     CHECK(id, "null irrep data pointer!");
+     d = id->d;
+     nx = d->nx; ny = d->ny; nz = d->nz;
+     cx = MAX2(1, nx/2); cy = MAX2(1, ny/2); cz = MAX2(1, nz/2);
+
+     /* k in the reciprocal-lattice basis: */
+     for (a = 0; a < 3; ++a) {
+	  id->k_set[a] = d->current_k[a];
+	  id->kappa[a] = id->R[a][0] * d->current_k[0]
+	       + id->R[a][1] * d->current_k[1]
+	       + id->R[a][2] * d->current_k[2];
+     }
+
+     /* W k = k + G0 for some reciprocal lattice vector G0 = -g0
+	(recall that G is negative in our FFT convention) */
+     for (iop = 0; iop < id->num_ops; ++iop) {
+	  const int *M = id->M + 9*iop;
+	  const real *kappa = id->kappa;
+	  for (a = 0; a < 3; ++a) {
+	       real g = kappa[a] - (M[3*a] * kappa[0] + M[3*a+1] * kappa[1]
+				    + M[3*a+2] * kappa[2]);
+	       id->g0[3*iop + a] = round_int(g);
+	       CHECK(fabs(g - id->g0[3*iop + a]) < 1e-6,
+		     "symmetry operation is not in the little group of k");
+	  }
+     }
+
+     /* find the planewaves whose entire orbit lies within the grid;
+	this set is closed under the group, so restricted to it P is
+	an exact projector */
+     for (i = 0; i < d->local_N; ++i)
+	  id->in_grid[i] = 1;
+     for (iop = 0; iop < id->num_ops; ++iop)
+	  for (ig = 0; ig < d->N; ++ig) {
+	       int x = ig / (ny * nz), y = (ig / nz) % ny, z = ig % nz;
+	       if ((i = MAXWELL_PLANEWAVE(d, ig)) < 0)
+		    continue;
+	       n[0] = (x >= cx) ? (x - nx) : x;
+	       n[1] = (y >= cy) ? (y - ny) : y;
+	       n[2] = (z >= cz) ? (z - nz) : z;
+	       if (irrep_map_planewave(d, id->M + 9*iop, id->g0 + 3*iop,
+				       n, n2) < 0)
+		    id->in_grid[i] = 0;
+	  }
+
+     id->have_k = 1;
+}
+
+/* Project X onto the irrep given by the maxwell_irrep_data. */
+void maxwell_irrep_constraint(evectmatrix X, void *data)
+{
+     maxwell_irrep_data *id = (maxwell_irrep_data *) data;
+     maxwell_data *d;
+     int nx, ny, nz, cx, cy, cz;
+     int iop, i, ig, a, n[3], n2[3];
+     const real *kappa;
+
+     CHECK(id, "null irrep data pointer!");
+     d = id->d;
+     CHECK(X.c == 2, "fields don't have 2 components!");
+     CHECK(X.localN == X.N,
+	   "irrep projection requires all planewaves on one process");
+     CHECK(X.n * X.p <= id->Y_size, "irrep projection scratch too small");
+     CHECK(id->have_k && id->k_set[0] == d->current_k[0]
+	   && id->k_set[1] == d->current_k[1]
+	   && id->k_set[2] == d->current_k[2],
+	   "maxwell_irrep_set_k must be called after the k point is set");
+
+     nx = d->nx; ny = d->ny; nz = d->nz;
+     cx = MAX2(1, nx/2); cy = MAX2(1, ny/2); cz = MAX2(1, nz/2);
+     kappa = id->kappa;
+
+     for (i = 0; i < X.n * X.p; ++i)
+	  ASSIGN_ZERO(id->Y[i]);
+
+     for (iop = 0; iop < id->num_ops; ++iop) {
+	  const real *Wc = id->Wc + 9*iop;
+	  const real *w = id->w + 3*iop;
+	  real chi_re = CSCALAR_RE(id->chi[iop]);
+	  real chi_im = CSCALAR_IM(id->chi[iop]);
+
+	  for (ig = 0; ig < d->N; ++ig) {
+	       int x = ig / (ny * nz), y = (ig / nz) % ny, z = ig % nz;
+	       int i2, b;
+	       k_data *k1, *k2;
+	       real Wm[3], Wn[3], mm, mn, nm, nn, phi, p_re, p_im;
+
+	       if ((i = MAXWELL_PLANEWAVE(d, ig)) < 0 || !id->in_grid[i])
+		    continue;
+	       k1 = d->k_plus_G + i;
+	       n[0] = (x >= cx) ? (x - nx) : x;
+	       n[1] = (y >= cy) ? (y - ny) : y;
+	       n[2] = (z >= cz) ? (z - nz) : z;
+	       i2 = irrep_map_planewave(d, id->M + 9*iop, id->g0 + 3*iop,
+					n, n2);
+	       k2 = d->k_plus_G + i2;
+
+	       /* rotate the m and n basis vectors at k+G and project
+		  them onto the basis at W(k+G) = k+G': */
+	       for (a = 0; a < 3; ++a) {
+		    Wm[a] = Wc[3*a] * k1->mx + Wc[3*a+1] * k1->my
+			 + Wc[3*a+2] * k1->mz;
+		    Wn[a] = Wc[3*a] * k1->nx + Wc[3*a+1] * k1->ny
+			 + Wc[3*a+2] * k1->nz;
+	       }
+	       mm = k2->mx * Wm[0] + k2->my * Wm[1] + k2->mz * Wm[2];
+	       nm = k2->nx * Wm[0] + k2->ny * Wm[1] + k2->nz * Wm[2];
+	       mn = k2->mx * Wn[0] + k2->my * Wn[1] + k2->mz * Wn[2];
+	       nn = k2->nx * Wn[0] + k2->ny * Wn[1] + k2->nz * Wn[2];
+
+	       /* conj(chi) * exp(-i (k+G').w), with k+G' in the
+		  reciprocal basis given by kappa - n2: */
+	       phi = -TWOPI * ((kappa[0] - n2[0]) * w[0]
+			       + (kappa[1] - n2[1]) * w[1]
+			       + (kappa[2] - n2[2]) * w[2]);
+	       p_re = chi_re * cos(phi) + chi_im * sin(phi);
+	       p_im = chi_re * sin(phi) - chi_im * cos(phi);
+
+	       for (b = 0; b < X.p; ++b) {
+		    scalar u, v, *Yu, *Yv;
+		    real u2_re, u2_im, v2_re, v2_im;
+		    u = X.data[(i * 2) * X.ld + b];
+		    v = X.data[(i * 2 + 1) * X.ld + b];
+		    u2_re = mm * SCALAR_RE(u) + mn * SCALAR_RE(v);
+		    u2_im = mm * SCALAR_IM(u) + mn * SCALAR_IM(v);
+		    v2_re = nm * SCALAR_RE(u) + nn * SCALAR_RE(v);
+		    v2_im = nm * SCALAR_IM(u) + nn * SCALAR_IM(v);
+		    Yu = id->Y + (i2 * 2) * X.p + b;
+		    Yv = id->Y + (i2 * 2 + 1) * X.p + b;
+		    ASSIGN_SCALAR(*Yu,
+				  SCALAR_RE(*Yu) + p_re*u2_re - p_im*u2_im,
+				  SCALAR_IM(*Yu) + p_re*u2_im + p_im*u2_re);
+		    ASSIGN_SCALAR(*Yv,
+				  SCALAR_RE(*Yv) + p_re*v2_re - p_im*v2_im,
+				  SCALAR_IM(*Yv) + p_re*v2_im + p_im*v2_re);
+	       }
+	  }
+     }
+
+     for (i = 0; i < X.n; ++i) {
+	  int b;
+	  for (b = 0; b < X.p; ++b)
+	       ASSIGN_SCALAR(X.data[i * X.ld + b],
+			     id->norm * SCALAR_RE(id->Y[i * X.p + b]),
+			     id->norm * SCALAR_IM(id->Y[i * X.p + b]));
+     }
+}
+
+/**************************************************************************/
+
 /* to fix problems with slow convergence for k ~ 0, manually "put in"
    the k = 0 solution: first two bands are constant and higher bands are
    orthogonal.  Note that in the TE/TM case, only one band is constant. 
@@ -355,7 +716,7 @@ void maxwell_zero_k_set_const_bands(evectmatrix X, maxwell_data *d)
      /* Initialize num_const_bands to zero: */
      for (i = 0; i < X.n; ++i) 
 	  for (j = 0; j < num_const_bands; ++j) {
-	       ASSIGN_ZERO(X.data[i * X.p + j]);
+	       ASSIGN_ZERO(X.data[i * X.ld + j]);
 	  }
      
      if (X.Nstart > 0)
@@ -370,11 +731,11 @@ void maxwell_zero_k_set_const_bands(evectmatrix X, maxwell_data *d)
 
      if (m_band) {
 	  ASSIGN_SCALAR(X.data[0], 1.0, 0.0);
-	  ASSIGN_SCALAR(X.data[X.p], 0.0, 0.0);
+	  ASSIGN_SCALAR(X.data[X.ld], 0.0, 0.0);
      }
      if (n_band && (!m_band || X.p >= 2)) {
 	  ASSIGN_SCALAR(X.data[m_band], 0.0, 0.0);
-	  ASSIGN_SCALAR(X.data[X.p + m_band], 1.0, 0.0);
+	  ASSIGN_SCALAR(X.data[X.ld + m_band], 1.0, 0.0);
      }
 }
 
@@ -389,7 +750,7 @@ void maxwell_zero_k_constraint(evectmatrix X, void *data)
 		      
      for (j = 0; j < X.p; ++j) {
 	  ASSIGN_ZERO(X.data[j]);
-	  ASSIGN_ZERO(X.data[X.p + j]);
+	  ASSIGN_ZERO(X.data[X.ld + j]);
      }
      (void)data; /* avoid warning about unused parameter */
 }
@@ -18,12 +18,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 
 #include "config.h"
 #include <check.h>
 #include <sphere-quad.h>
 #include <mpiglue.h>
 #include <mpi_utils.h>
+#include <large_malloc.h>
 
 #include "maxwell.h"
 #include "xyz_loop.h"
@@ -290,6 +292,175 @@ int check_maxwell_dielectric(maxwell_data *d,
      return 0;
 }
 
+#if defined(SCALAR_COMPLEX)
+/* whether a and b are equal to within tol, with b conjugated
+   (PT symmetry) in the hermitian case: */
+static int sym_matrix_conj_eq(symmetric_matrix a, symmetric_matrix b,
+			      real tol)
+{
+#  if defined(WITH_HERMITIAN_EPSILON)
+     return (EQ(a.m00, b.m00) && EQ(a.m11, b.m11) && EQ(a.m22, b.m22) &&
+	     EQ(a.m01.re, b.m01.re) && EQ(a.m01.im, -b.m01.im) &&
+	     EQ(a.m02.re, b.m02.re) && EQ(a.m02.im, -b.m02.im) &&
+	     EQ(a.m12.re, b.m12.re) && EQ(a.m12.im, -b.m12.im));
+#  else
+     return (EQ(a.m00, b.m00) && EQ(a.m11, b.m11) && EQ(a.m22, b.m22) &&
+	     EQ(a.m01, b.m01) && EQ(a.m02, b.m02) && EQ(a.m12, b.m12));
+#  endif
+}
+
+/* index in m of the point (x,y,z), for y on this process, and the
+   offset of (x,z) from (0,z) in a y = const. plane; the first two
+   dimensions are transposed in the MPI output (see xyz_loop.h) */
+#  ifdef HAVE_MPI
+#    define EPS_INDEX(d, x, y, z) \
+	  ((((y) - (d)->local_y_start) * (d)->nx + (x)) * (d)->nz + (z))
+#    define PLANE_INDEX(d, x, z) ((x) * (d)->nz + (z))
+#  else
+#    define EPS_INDEX(d, x, y, z) ((((x) * (d)->ny + (y)) * (d)->nz + (z)))
+#    define PLANE_INDEX(d, x, z) ((x) * (d)->ny * (d)->nz + (z))
+#  endif
+
+#  ifdef HAVE_MPI
+/* the process whose slab (of the ystart/nys slabs) contains y */
+static int y_owner(int y, int np, const int *ystart, const int *nys)
+{
+     int q;
+     for (q = 0; q < np && !(y >= ystart[q] && y < ystart[q] + nys[q]); ++q)
+	  ;
+     CHECK(q < np, "bug: y plane not found");
+     return q;
+}
+#  endif
+
+/* Compare each y = const. plane of m with the plane at -y.  Under MPI,
+   each process receives the mirror images of its planes (point to
+   point) from the processes that own them. */
+static int sym_matrix_array_inversion_symmetric(maxwell_data *d,
+						symmetric_matrix *m,
+						real tol)
+{
+     int nx = d->nx, ny = d->ny, nz = d->nz, x, y, z, i, sym = 1;
+     int y0 = d->local_y_start, y1 = d->local_y_start + d->local_ny;
+     real mmax = 0, mmax_local = 0;
+     symmetric_matrix *mirror;
+#  ifdef HAVE_MPI
+     int np, q, nreal = nx * nz * sizeof(symmetric_matrix) / sizeof(real);
+     int *ystart, *nys, *scount, *rcount, *rpos, nreq = 0;
+     symmetric_matrix *sbuf, *rbuf, *sp, *rp;
+     MPI_Request *reqs;
+#  endif
+
+     for (i = 0; i < d->fft_output_size; ++i) {
+	  if (fabs(m[i].m00) > mmax_local) mmax_local = fabs(m[i].m00);
+	  if (fabs(m[i].m11) > mmax_local) mmax_local = fabs(m[i].m11);
+	  if (fabs(m[i].m22) > mmax_local) mmax_local = fabs(m[i].m22);
+     }
+     mpi_allreduce(&mmax_local, &mmax, 1, real, SCALAR_MPI_TYPE,
+		   MPI_MAX, mpb_comm);
+     tol *= mmax;
+
+#  ifdef HAVE_MPI
+     MPI_Comm_size(mpb_comm, &np);
+     CHK_MALLOC(ystart, int, np);
+     CHK_MALLOC(nys, int, np);
+     MPI_Allgather(&d->local_y_start, 1, MPI_INT, ystart, 1, MPI_INT,
+		   mpb_comm);
+     MPI_Allgather(&d->local_ny, 1, MPI_INT, nys, 1, MPI_INT, mpb_comm);
+
+     /* the number of planes we send to and receive from each process;
+	both sides list them in the order of the receiver's y: */
+     CHK_MALLOC(scount, int, np);
+     CHK_MALLOC(rcount, int, np);
+     CHK_MALLOC(rpos, int, np);
+     for (q = 0; q < np; ++q) {
+	  scount[q] = rcount[q] = 0;
+	  for (y = ystart[q]; y < ystart[q] + nys[q]; ++y)
+	       if ((ny - y) % ny >= y0 && (ny - y) % ny < y1)
+		    ++scount[q];
+     }
+     for (y = y0; y < y1; ++y)
+	  ++rcount[y_owner((ny - y) % ny, np, ystart, nys)];
+
+     CHK_MALLOC(sbuf, symmetric_matrix, (d->local_ny > 0 ? d->local_ny : 1) * nx * nz);
+     CHK_MALLOC(rbuf, symmetric_matrix, (d->local_ny > 0 ? d->local_ny : 1) * nx * nz);
+     CHK_MALLOC(reqs, MPI_Request, 2 * np);
+     for (q = 0, rp = rbuf; q < np; rp += rcount[q++] * nx * nz)
+	  if (rcount[q])
+	       MPI_Irecv(rp, rcount[q] * nreal, SCALAR_MPI_TYPE, q, 0,
+			 mpb_comm, &reqs[nreq++]);
+     for (q = 0, sp = sbuf; q < np; ++q) {
+	  symmetric_matrix *sp0 = sp;
+	  for (y = ystart[q]; y < ystart[q] + nys[q]; ++y) {
+	       int ym = (ny - y) % ny;
+	       if (ym >= y0 && ym < y1) {
+		    memcpy(sp, m + EPS_INDEX(d, 0, ym, 0),
+			   sizeof(symmetric_matrix) * nx * nz);
+		    sp += nx * nz;
+	       }
+	  }
+	  if (scount[q])
+	       MPI_Isend(sp0, scount[q] * nreal, SCALAR_MPI_TYPE, q, 0,
+			 mpb_comm, &reqs[nreq++]);
+     }
+     MPI_Waitall(nreq, reqs, MPI_STATUSES_IGNORE);
+     for (q = i = 0; q < np; i += rcount[q++])
+	  rpos[q] = i;
+#  endif
+
+     for (y = y0; y < y1 && sym; ++y) {
+#  ifdef HAVE_MPI
+	  q = y_owner((ny - y) % ny, np, ystart, nys);
+	  mirror = rbuf + (rpos[q]++) * nx * nz;
+#  else
+	  mirror = m + EPS_INDEX(d, 0, (ny - y) % ny, 0);
+#  endif
+	  for (x = 0; x < nx && sym; ++x)
+	       for (z = 0; z < nz && sym; ++z)
+		    sym = sym_matrix_conj_eq(
+			 m[EPS_INDEX(d, x, y, z)],
+			 mirror[PLANE_INDEX(d, (nx - x) % nx, (nz - z) % nz)],
+			 tol);
+     }
+
+#  ifdef HAVE_MPI
+     free(reqs);
+     free(rbuf);
+     free(sbuf);
+     free(rpos);
+     free(rcount);
+     free(scount);
+     free(nys);
+     free(ystart);
+#  endif
+
+     mpi_allreduce_1(&sym, int, MPI_INT, MPI_MIN, mpb_comm);
+     return sym;
+}
+#endif
+
+/* Return whether the dielectric function (and mu, if any) on the grid
+   has inversion symmetry, eps(-r) = conj(eps(r)), to within a relative
+   tolerance tol, in which case the real-field (mpbi) build would solve
+   the same problem in about half the time and memory.  This is only
+   a check: the caller must still rerun with the real-field build to
+   take advantage of it.  Must be called by all processes.  In the
+   real-field build, which already assumes the symmetry, or if eps_inv
+   is not stored on the full grid, returns 0. */
+int maxwell_dielectric_inversion_symmetric(maxwell_data *d, real tol)
+{
+#if defined(SCALAR_COMPLEX)
+     if (d->fft_output_size != d->nx * d->local_ny * d->nz)
+	  return 0;
+     return (sym_matrix_array_inversion_symmetric(d, d->eps_inv, tol) &&
+	     (!d->mu_inv ||
+	      sym_matrix_array_inversion_symmetric(d, d->mu_inv, tol)));
+#else
+     (void) d; (void) tol;
+     return 0;
+#endif
+}
+
 /**************************************************************************/
 
 #define K_PI 3.141592653589793238462643383279502884197
@@ -399,64 +570,6 @@ static void get_moment_mesh(int nx, int ny, int nz,
      }
 }
 
-static symmetric_matrix average_eps_inv_over_mesh(real r[3],
-               maxwell_dielectric_function epsilon,
-               const int mesh_size[3],
-               real mesh_center[3],
-               real m1, real m2, real m3,
-               real mesh_prod_inv,
-               void *epsilon_data) {
-   symmetric_matrix eps_inv_mean;
-   int mi, mj, mk;
-     
-   eps_inv_mean.m00 = eps_inv_mean.m11 = eps_inv_mean.m22 = 0.0;
-   ASSIGN_ESCALAR(eps_inv_mean.m01, 0, 0);
-   ASSIGN_ESCALAR(eps_inv_mean.m02, 0, 0);
-   ASSIGN_ESCALAR(eps_inv_mean.m12, 0, 0);
-
-   /* sum up eps_inv over mesh points */
-   for (mi = 0; mi < mesh_size[0]; ++mi) {
-      for (mj = 0; mj < mesh_size[1]; ++mj) {
-         for (mk = 0; mk < mesh_size[2]; ++mk) {
-            real r_mesh[3];
-            symmetric_matrix eps, eps_inv;
-            r_mesh[0] = r[0] + (mi - mesh_center[0]) * m1;
-            r_mesh[1] = r[1] + (mj - mesh_center[1]) * m2;
-            r_mesh[2] = r[2] + (mk - mesh_center[2]) * m3;
-            epsilon(&eps, &eps_inv, r_mesh, epsilon_data);
-            eps_inv_mean.m00 += eps_inv.m00;
-            eps_inv_mean.m11 += eps_inv.m11;
-            eps_inv_mean.m22 += eps_inv.m22;
-            EACCUMULATE_SUM(eps_inv_mean.m01, eps_inv.m01);
-            EACCUMULATE_SUM(eps_inv_mean.m02, eps_inv.m02);
-            EACCUMULATE_SUM(eps_inv_mean.m12, eps_inv.m12);
-         }
-      }
-   }
-   
-   /* rescale to get average */
-   eps_inv_mean.m00 *= mesh_prod_inv;
-   eps_inv_mean.m11 *= mesh_prod_inv;
-   eps_inv_mean.m22 *= mesh_prod_inv;
-   /* if not a diagonal matrix, rescale off-diagonal entries as well */
-   if (!DIAG_SYMMETRIC_MATRIX(eps_inv_mean)) {
-#ifdef WITH_HERMITIAN_EPSILON
-      eps_inv_mean.m01.re *= mesh_prod_inv;
-      eps_inv_mean.m01.im *= mesh_prod_inv;
-      eps_inv_mean.m02.re *= mesh_prod_inv;
-      eps_inv_mean.m02.im *= mesh_prod_inv;
-      eps_inv_mean.m12.re *= mesh_prod_inv;
-      eps_inv_mean.m12.im *= mesh_prod_inv;
-#else
-      eps_inv_mean.m01 *= mesh_prod_inv;
-      eps_inv_mean.m02 *= mesh_prod_inv;
-      eps_inv_mean.m12 *= mesh_prod_inv;
-#endif
-   }
-
-   return eps_inv_mean;
-}
-
 /* Function to detect whether a voxel centered at `r` with sides `s1`, `s2`, & `s3`
    intersects a material interface (returns 1) or not (returns 0). 
    Intersection is based on whether or not the permittivity tensor evaluated at the
@@ -511,75 +624,290 @@ short detect_interface_via_corner_check(real r[3],
    return is_interface;
 }
 
-/**************************************************************************/
+/* The parameters of the averaging in set_maxwell_dielectric, which are
+   the same for every voxel. */
+typedef struct {
+     maxwell_dielectric_function epsilon;
+     maxwell_dielectric_mean_function mepsilon;
+     void *epsilon_data;
+     int rank;
+     real s1, s2, s3, m1, m2, m3;  /* grid/mesh steps */
+     int mesh_size[3];
+     real mesh_center[3];
+     real mesh_prod_inv;
+     real mesh_tol; /* if > 0, tolerance of adaptive_mesh_average */
+     real R[3][3];
+     real moment_mesh[MAX_MOMENT_MESH][3];
+     real moment_mesh_weights[MAX_MOMENT_MESH];
+     int size_moment_mesh;
+} voxel_eps_data;
 
-/* The following function initializes the dielectric tensor md->eps_inv,
-   using the dielectric function epsilon(&eps, &eps_inv, r, epsilon_data).
+/* a += w * b */
+static void sym_matrix_axpy(symmetric_matrix *a, real w,
+			    const symmetric_matrix *b)
+{
+     a->m00 += w * b->m00;
+     a->m11 += w * b->m11;
+     a->m22 += w * b->m22;
+#ifdef WITH_HERMITIAN_EPSILON
+     CACCUMULATE_SCALAR(a->m01, w * b->m01.re, w * b->m01.im);
+     CACCUMULATE_SCALAR(a->m02, w * b->m02.re, w * b->m02.im);
+     CACCUMULATE_SCALAR(a->m12, w * b->m12.re, w * b->m12.im);
+#else
+     a->m01 += w * b->m01;
+     a->m02 += w * b->m02;
+     a->m12 += w * b->m12;
+#endif
+}
 
-   epsilon is (Kottke) averaged over a rectangular mesh spanning the space
-   between grid points; the size of the mesh is given by mesh_size.
+static void sym_matrix_zero(symmetric_matrix *a)
+{
+     a->m00 = a->m11 = a->m22 = 0.0;
+     ASSIGN_ESCALAR(a->m01, 0.0, 0.0);
+     ASSIGN_ESCALAR(a->m02, 0.0, 0.0);
+     ASSIGN_ESCALAR(a->m12, 0.0, 0.0);
+}
 
-   R[0..2] are the spatial lattice vectors, and are used to convert
-   the discretization grid into spatial coordinates (with the origin
-   at the (0,0,0) grid element.
+/* max. |a - b| over the components, or max. |a| if b is NULL */
+static real sym_matrix_maxdiff(const symmetric_matrix *a,
+			       const symmetric_matrix *b)
+{
+     symmetric_matrix d = *a;
+     real m;
+     if (b)
+	  sym_matrix_axpy(&d, -1.0, b);
+     m = MAX2(fabs(d.m00), MAX2(fabs(d.m11), fabs(d.m22)));
+     m = MAX2(m, sqrt(ESCALAR_NORMSQR(d.m01)));
+     m = MAX2(m, sqrt(ESCALAR_NORMSQR(d.m02)));
+     return MAX2(m, sqrt(ESCALAR_NORMSQR(d.m12)));
+}
 
-   In most places, the dielectric tensor is equal to eps_inv, but at
-   dielectric interfaces it varies depending upon the polarization of
-   the field (for faster convergence).  In particular, it depends upon
-   the direction of the field relative to the surface normal vector,
-   so we must compute the latter.  The surface normal is approximated
-   by the "dipole moment" of the dielectric function over a spherical
-   mesh.
+/* The quantity averaged over a voxel: eps_inv, or if Rot is non-NULL,
+   τ(ε) for ε rotated by Rot into the coordinate system of an interface
+   (see the Kottke averaging in voxel_eps_inv). */
+static symmetric_matrix voxel_integrand(const real r[3], voxel_eps_data *v,
+					double Rot[3][3])
+{
+     symmetric_matrix eps, eps_inv, teps, tau;
 
-   Implementation note: md->eps_inv is chosen to have dimensions matching
-   the output of the FFT.  Thus, its dimensions depend upon whether we are
-   doing a real or complex and serial or parallel FFT. */
+     v->epsilon(&eps, &eps_inv, r, v->epsilon_data); /* tensor in cartesian system */
+     if (!Rot)
+	  return eps_inv;
 
-void set_maxwell_dielectric(maxwell_data *md,
-			    const int mesh_size[3],
-			    real R[3][3], real G[3][3],
-			    maxwell_dielectric_function epsilon,
-			    maxwell_dielectric_mean_function mepsilon,
-			    void *epsilon_data)
-{
-     real s1, s2, s3, m1, m2, m3;  /* grid/mesh steps */
-     real mesh_center[3];
-     real moment_mesh[MAX_MOMENT_MESH][3];
-     real moment_mesh_weights[MAX_MOMENT_MESH];
-     real eps_inv_total = 0.0;
-     int mesh_prod;
-     real mesh_prod_inv;
-     int size_moment_mesh = 0;
-     int n1 = md->nx, n2 = md->ny, n3 = md->nz;
-     int rank = n3 > 1 ? 3 : (n2 > 1 ? 2 : 1);
-     short is_interface;
-#ifdef HAVE_MPI
-     int local_n2, local_y_start, local_n3;
-#endif
-#ifndef SCALAR_COMPLEX
-     int n_other, n_last;
+     /* rotate epsilon tensor to interface coordinate system */
+     maxwell_sym_matrix_rotate(&teps, &eps, Rot);
+
+     tau.m00 = -1.0/teps.m00;                                                /* -1/ε₁₁         */
+     tau.m11 = teps.m11 - ESCALAR_NORMSQR(teps.m01)/teps.m00;                /* ε₂₂-ε₂₁ε₁₂/ε₁₁ */
+     tau.m22 = teps.m22 - ESCALAR_NORMSQR(teps.m02)/teps.m00;                /* ε₃₃-ε₃₁ε₁₃/ε₁₁ */
+#ifdef WITH_HERMITIAN_EPSILON
+     CASSIGN_SCALAR(tau.m01, teps.m01.re/teps.m00, teps.m01.im/teps.m00);    /* ε₁₂/ε₁₁        */
+     CASSIGN_SCALAR(tau.m02, teps.m02.re/teps.m00, teps.m02.im/teps.m00);    /* ε₁₃/ε₁₁        */
+     CASSIGN_SCALAR(tau.m12,                                                 /* ε₂₃-ε₂₁ε₁₃/ε₁₁ */
+		    teps.m12.re - CSCALAR_MULT_CONJ_RE(teps.m02, teps.m01)/teps.m00,
+		    teps.m12.im - CSCALAR_MULT_CONJ_IM(teps.m02, teps.m01)/teps.m00);
+#else
+     tau.m01 = teps.m01/teps.m00;                                            /* ε₁₂/ε₁₁        */
+     tau.m02 = teps.m02/teps.m00;                                            /* ε₁₃/ε₁₁        */
+     tau.m12 = teps.m12 - teps.m01*teps.m02/teps.m00;                        /* ε₂₃-ε₂₁ε₁₃/ε₁₁ */
 #endif
+     return tau;
+}
 
-     /* integration mesh for checking whether voxel intersects an interface */
-     get_mesh(mesh_size, mesh_center, &mesh_prod); 
-     mesh_prod_inv = 1.0 / mesh_prod;
+typedef struct {
+     real c[3]; /* center of the cell */
+     symmetric_matrix f; /* voxel_integrand at c */
+     int sides; /* bit 2*d (2*d+1) set if the neighbor of the cell below
+		   (above) it in dimension d has a different f */
+} mesh_cell;
 
-     s1 = 1.0 / n1;
-     s2 = 1.0 / n2;
-     s3 = 1.0 / n3;
-     m1 = s1 / MAX2(1, mesh_size[0]);
-     m2 = s2 / MAX2(1, mesh_size[1]);
-     m3 = s3 / MAX2(1, mesh_size[2]);
+#define MESH_MAX_REFINE 5 /* maximum halvings of the mesh_size mesh */
 
-     /* spherical integration mesh for computing normal vectors */
-     get_moment_mesh(n1, n2, n3, R, G, moment_mesh, moment_mesh_weights, &size_moment_mesh);
+/* Compare the cell c with the value f of its neighbor on the given side. */
+static void mesh_cell_compare(mesh_cell *c, const symmetric_matrix *f,
+			      int side)
+{
+     if (sym_matrix_maxdiff(&c->f, f) > SMALL)
+	  c->sides |= 1 << side;
+}
 
-     LOOP_XYZ(md) {
-	     int mi, mj, mk;
-	     symmetric_matrix eps_mean, eps_inv_mean;
-	     real norm_len;
-	     real norm0, norm1, norm2;
-        real r[3], normal[3];
+/* Add w times the f of the cells that are not next to an interface to
+   *finished, and move the others to the start of cells, returning
+   their number. */
+static int mesh_cells_finish(mesh_cell *cells, int ncells, real w,
+			     symmetric_matrix *finished)
+{
+     int i, nnew = 0;
+     for (i = 0; i < ncells; ++i) {
+	  if (cells[i].sides)
+	       cells[nnew++] = cells[i];
+	  else
+	       sym_matrix_axpy(finished, w, &cells[i].f);
+     }
+     return nnew;
+}
+
+/* Average voxel_integrand over the voxel centered at r by adaptive
+   refinement of the mesh_size mesh.  The cells of the mesh whose value
+   differs from that of a neighbor (or of the voxel face), i.e. that are
+   next to an interface, are split in two along each dimension (of the
+   grid), and so on for the new cells next to an interface, until the
+   average changes by less than mesh_tol (relative to its largest
+   component) from one level to the next, or after MESH_MAX_REFINE
+   levels.  (Features of epsilon smaller than the mesh, which are
+   missed by the mesh_size mesh, are still missed.)  The samples are
+   thus concentrated along the interfaces in the voxel, rather than
+   spread over the whole voxel as for a finer uniform mesh. */
+static symmetric_matrix adaptive_mesh_average(const real r[3],
+					      voxel_eps_data *v,
+					      double Rot[3][3])
+{
+     int ms[3], stride[3], ncells = 1, nchild = 1 << v->rank;
+     int depth, i, j, d;
+     real h[3], w;
+     mesh_cell *cells, *children;
+     symmetric_matrix finished, estimate;
+
+     for (d = 2; d >= 0; --d) {
+	  ms[d] = MAX2(1, v->mesh_size[d]);
+	  stride[d] = ncells;
+	  ncells *= ms[d];
+     }
+     h[0] = v->m1; h[1] = v->m2; h[2] = v->m3;
+     w = v->mesh_prod_inv;
+
+     /* the mesh_size mesh, comparing each cell with its neighbors */
+     CHK_MALLOC(cells, mesh_cell, ncells);
+     for (i = 0; i < ncells; ++i) {
+	  for (d = 0; d < 3; ++d)
+	       cells[i].c[d] = r[d] + ((i / stride[d]) % ms[d]
+				       - v->mesh_center[d]) * h[d];
+	  cells[i].f = voxel_integrand(cells[i].c, v, Rot);
+	  cells[i].sides = 0;
+     }
+     for (i = 0; i < ncells; ++i)
+	  for (d = 0; d < v->rank; ++d) {
+	       int k = (i / stride[d]) % ms[d], hi;
+	       for (hi = 0; hi <= 1; ++hi) {
+		    if (hi ? k < ms[d] - 1 : k > 0)
+			 mesh_cell_compare(cells + i,
+					   &cells[i + (hi ? stride[d]
+						       : -stride[d])].f,
+					   2*d + hi);
+		    else { /* compare with the voxel face */
+			 real rf[3];
+			 symmetric_matrix f;
+			 rf[0] = cells[i].c[0];
+			 rf[1] = cells[i].c[1];
+			 rf[2] = cells[i].c[2];
+			 rf[d] += (hi ? 0.5 : -0.5) * h[d];
+			 f = voxel_integrand(rf, v, Rot);
+			 mesh_cell_compare(cells + i, &f, 2*d + hi);
+		    }
+	       }
+	  }
+     sym_matrix_zero(&finished);
+     sym_matrix_zero(&estimate);
+     ncells = mesh_cells_finish(cells, ncells, w, &finished);
+
+     for (depth = 0; ; ++depth) {
+	  symmetric_matrix prev_estimate = estimate;
+
+	  estimate = finished;
+	  for (i = 0; i < ncells; ++i)
+	       sym_matrix_axpy(&estimate, w, &cells[i].f);
+	  if (ncells == 0 || depth == MESH_MAX_REFINE
+	      || (depth > 0 && sym_matrix_maxdiff(&estimate, &prev_estimate)
+		  <= v->mesh_tol * sym_matrix_maxdiff(&estimate, NULL)))
+	       break;
+
+	  CHK_MALLOC(children, mesh_cell, ncells * nchild);
+	  for (i = 0; i < ncells; ++i) {
+	       mesh_cell *c = children + i * nchild;
+	       for (j = 0; j < nchild; ++j) {
+		    for (d = 0; d < 3; ++d)
+			 c[j].c[d] = cells[i].c[d] + (d >= v->rank ? 0 :
+						      ((j >> d) & 1 ? 0.25 : -0.25)
+						      * h[d]);
+		    c[j].f = voxel_integrand(c[j].c, v, Rot);
+	       }
+	       /* the outer sides of the children are those of the cell,
+		  and the inner sides are found from their siblings */
+	       for (j = 0; j < nchild; ++j) {
+		    c[j].sides = 0;
+		    for (d = 0; d < v->rank; ++d) {
+			 int hi = (j >> d) & 1;
+			 c[j].sides |= cells[i].sides & (1 << (2*d + hi));
+			 mesh_cell_compare(c + j, &c[j ^ (1 << d)].f,
+					   2*d + 1 - hi);
+		    }
+	       }
+	  }
+	  free(cells);
+	  cells = children;
+	  w /= nchild;
+	  for (d = 0; d < v->rank; ++d)
+	       h[d] *= 0.5;
+	  ncells = mesh_cells_finish(cells, ncells * nchild, w, &finished);
+     }
+     free(cells);
+     return estimate;
+}
+
+/* Average voxel_integrand over the voxel centered at r, over the
+   mesh_size mesh or adaptively (if mesh_tol > 0). */
+static symmetric_matrix mesh_average(const real r[3], voxel_eps_data *v,
+				     double Rot[3][3])
+{
+     symmetric_matrix sum, mean;
+     int mi, mj, mk;
+
+     if (v->mesh_tol > 0)
+	  return adaptive_mesh_average(r, v, Rot);
+
+     /* sum over voxel mesh points */
+     sym_matrix_zero(&sum);
+     for (mi = 0; mi < v->mesh_size[0]; ++mi) {
+	  for (mj = 0; mj < v->mesh_size[1]; ++mj) {
+	       for (mk = 0; mk < v->mesh_size[2]; ++mk) {
+		    real r_mesh[3];
+		    symmetric_matrix f;
+		    r_mesh[0] = r[0] + (mi - v->mesh_center[0]) * v->m1;
+		    r_mesh[1] = r[1] + (mj - v->mesh_center[1]) * v->m2;
+		    r_mesh[2] = r[2] + (mk - v->mesh_center[2]) * v->m3;
+		    f = voxel_integrand(r_mesh, v, Rot);
+		    sym_matrix_axpy(&sum, 1.0, &f);
+	       }
+	  }
+     }
+
+     /* rescale to get average */
+     sym_matrix_zero(&mean);
+     sym_matrix_axpy(&mean, v->mesh_prod_inv, &sum);
+     return mean;
+}
+
+/* Set *eps_inv_out to the averaged inverse dielectric tensor of the
+   voxel at the grid point (i1,i2,i3) (see set_maxwell_dielectric). */
+static void voxel_eps_inv(symmetric_matrix *eps_inv_out,
+			  int i1, int i2, int i3, voxel_eps_data *v)
+{
+     maxwell_dielectric_function epsilon = v->epsilon;
+     maxwell_dielectric_mean_function mepsilon = v->mepsilon;
+     void *epsilon_data = v->epsilon_data;
+     real s1 = v->s1, s2 = v->s2, s3 = v->s3;
+     real mesh_prod_inv = v->mesh_prod_inv;
+     real (*R)[3] = v->R;
+     real (*moment_mesh)[3] = v->moment_mesh;
+     real *moment_mesh_weights = v->moment_mesh_weights;
+     int size_moment_mesh = v->size_moment_mesh;
+     int rank = v->rank;
+     short is_interface;
+     int mi;
+     symmetric_matrix eps_mean, eps_inv_mean;
+     real norm_len;
+     real norm0, norm1, norm2;
+     real r[3], normal[3];
 
 	     r[0] = i1 * s1;
 	     r[1] = i2 * s2;
@@ -589,9 +917,9 @@ void set_maxwell_dielectric(maxwell_data *md,
 					s1, s2, s3, mesh_prod_inv,
 					r, epsilon_data)) {
 
-		     maxwell_sym_matrix_invert(md->eps_inv + xyz_index, &eps_mean);
+		     maxwell_sym_matrix_invert(eps_inv_out, &eps_mean);
 
-		     goto got_eps_inv;
+		     return;
 
 #if !defined(SCALAR_COMPLEX) && 0 /* check inversion symmetry */
 		    {
@@ -670,61 +998,8 @@ void set_maxwell_dielectric(maxwell_data *md,
            norm2 *= norm_len;
            maxwell_rotation_matrix(Rot, norm0, norm1, norm2);
 
-           /* sum over voxel mesh points, accumulating mesh_prod*mean[τ(ε)] */
-           tau.m00 = tau.m11 = tau.m22 = 0.0;
-           ASSIGN_ESCALAR(tau.m01, 0.0, 0.0);
-           ASSIGN_ESCALAR(tau.m02, 0.0, 0.0);
-           ASSIGN_ESCALAR(tau.m12, 0.0, 0.0);
-           for (mi = 0; mi < mesh_size[0]; ++mi) {
-              for (mj = 0; mj < mesh_size[1]; ++mj) {
-                 for (mk = 0; mk < mesh_size[2]; ++mk) {
-                    real r_mesh[3];
-                    symmetric_matrix eps, eps_inv, teps;
-                    r_mesh[0] = r[0] + (mi - mesh_center[0]) * m1;
-                    r_mesh[1] = r[1] + (mj - mesh_center[1]) * m2;
-                    r_mesh[2] = r[2] + (mk - mesh_center[2]) * m3;
-                    epsilon(&eps, &eps_inv, r_mesh, epsilon_data); /* tensor in cartesian system */
-
-                    /* rotate epsilon tensor to interface coordinate system */
-                    maxwell_sym_matrix_rotate(&teps, &eps, Rot);
-
-                    /* integrate τ(ε) */
-                    tau.m00 += -1.0/teps.m00;                                                /* -1/ε₁₁         */
-                    tau.m11 += teps.m11 - ESCALAR_NORMSQR(teps.m01)/teps.m00;                /* ε₂₂-ε₂₁ε₁₂/ε₁₁ */
-                    tau.m22 += teps.m22 - ESCALAR_NORMSQR(teps.m02)/teps.m00;                /* ε₃₃-ε₃₁ε₁₃/ε₁₁ */
-
-#ifdef WITH_HERMITIAN_EPSILON
-                    CACCUMULATE_SCALAR(tau.m01, teps.m01.re/teps.m00, teps.m01.im/teps.m00); /* ε₁₂/ε₁₁        */
-                    CACCUMULATE_SCALAR(tau.m02, teps.m02.re/teps.m00, teps.m02.im/teps.m00); /* ε₁₃/ε₁₁        */
-                    CACCUMULATE_SCALAR(tau.m12,                                              /* ε₂₃-ε₂₁ε₁₃/ε₁₁ */
-                        teps.m12.re - CSCALAR_MULT_CONJ_RE(teps.m02, teps.m01)/teps.m00,
-                        teps.m12.im - CSCALAR_MULT_CONJ_IM(teps.m02, teps.m01)/teps.m00 );
-                    
-#else
-                    tau.m01 += teps.m01/teps.m00;                                            /* ε₁₂/ε₁₁        */
-                    tau.m02 += teps.m02/teps.m00;                                            /* ε₁₃/ε₁₁        */
-                    tau.m12 += teps.m12 - teps.m01*teps.m02/teps.m00;                        /* ε₂₃-ε₂₁ε₁₃/ε₁₁ */
-#endif
-                 }
-              }
-           }
-           
-           /* normalize τ-summation to get mean */
-           tau.m00 *= mesh_prod_inv;
-           tau.m11 *= mesh_prod_inv;
-           tau.m22 *= mesh_prod_inv;
-#ifdef WITH_HERMITIAN_EPSILON
-           tau.m01.re *= mesh_prod_inv;
-           tau.m02.re *= mesh_prod_inv;
-           tau.m12.re *= mesh_prod_inv;
-           tau.m01.im *= mesh_prod_inv;
-           tau.m02.im *= mesh_prod_inv;
-           tau.m12.im *= mesh_prod_inv;
-#else
-           tau.m01 *= mesh_prod_inv;
-           tau.m02 *= mesh_prod_inv;
-           tau.m12 *= mesh_prod_inv;
-#endif
+           /* average τ(ε) over the voxel */
+           tau = mesh_average(r, v, Rot);
            
            /* --- compute τ⁻¹[mean(τ(ε))] (i.e. the Kottke-averaged permittivity) --- */
            /* τ⁻¹(τ) is defined by [Kottke PRE, Eq. (23)]:
@@ -753,32 +1028,204 @@ void set_maxwell_dielectric(maxwell_data *md,
 #undef SWAP
 
            /* invert eps_mean to get the Kottke averaged inverse permittivity */
-            maxwell_sym_matrix_invert(md->eps_inv + xyz_index, &eps_mean);
+            maxwell_sym_matrix_invert(eps_inv_out, &eps_mean);
 
 	  }
 	  else { /* undetermined normal vector and/or constant eps */
         if (is_interface) { /* if normal is nearly zero but an interface was detected
                                fall back to ordinary averaging (e.g. for smooth epsilon) */
-           eps_inv_mean = average_eps_inv_over_mesh(r, epsilon, mesh_size, mesh_center,
-                                       m1, m2, m3, mesh_prod_inv, epsilon_data);
+           eps_inv_mean = mesh_average(r, v, NULL);
         }
         else {              /* otherwise, assume constant epsilon in voxel */
            epsilon(&eps_mean, &eps_inv_mean, r, epsilon_data);
         }
-        md->eps_inv[xyz_index] = eps_inv_mean;
+        *eps_inv_out = eps_inv_mean;
 	  }
-     got_eps_inv:
+}
+
+#ifdef HAVE_MPI
+/* Number of the indices me, me + np, me + 2*np, ... that are < x. */
+static int cyclic_count(int x, int me, int np)
+{
+     return x > me ? (x - me - 1) / np + 1 : 0;
+}
+
+/* Compute md->eps_inv with the work divided evenly among the processes,
+   rather than each process computing the voxels of its own slab: the
+   cost of the averaging is concentrated in the voxels at interfaces,
+   which may lie in only a few of the slabs.  The voxels, numbered in
+   the order of the slabs (in which each process's xyz_index is
+   consecutive), are dealt out cyclically to the processes, and the
+   results are sent back to their slabs.  (This relies on epsilon being
+   defined everywhere on every process, as it is in MPB.) */
+static void set_eps_inv_balanced(maxwell_data *md, voxel_eps_data *v)
+{
+     int np, me, q, j, n1 = md->nx, n3, total, nwork;
+     int *sizes, *starts, *scounts, *sdispls, *rcounts, *rdispls;
+     symmetric_matrix *work, *recv;
+     MPI_Datatype t;
+
+#ifdef SCALAR_COMPLEX
+     n3 = md->nz;
+#else
+     n3 = md->nz > 1 ? md->last_dim_size / 2 : 1;
+#endif
+
+     MPI_Comm_size(mpb_comm, &np);
+     MPI_Comm_rank(mpb_comm, &me);
+
+     CHK_MALLOC(sizes, int, np);
+     CHK_MALLOC(starts, int, np);
+     j = md->local_ny * n1 * n3;
+     MPI_Allgather(&j, 1, MPI_INT, sizes, 1, MPI_INT, mpb_comm);
+     j = md->local_y_start * n1 * n3;
+     MPI_Allgather(&j, 1, MPI_INT, starts, 1, MPI_INT, mpb_comm);
+     for (total = 0, q = 0; q < np; ++q) {
+	  CHECK(starts[q] == total, "bug: slabs are not in process order");
+	  total += sizes[q];
+     }
 
-	  eps_inv_total += (md->eps_inv[xyz_index].m00 +
-			    md->eps_inv[xyz_index].m11 +
-			    md->eps_inv[xyz_index].m22);
-     }}}  /* end of loop body */
+     /* compute our share of the voxels, in increasing order: */
+     nwork = cyclic_count(total, me, np);
+     CHK_MALLOC(work, symmetric_matrix, nwork);
+     for (j = 0; j < nwork; ++j) {
+	  int index = me + j * np;
+	  voxel_eps_inv(work + j, (index / n3) % n1, index / (n3 * n1),
+			index % n3, v);
+     }
+
+     /* send the results for each slab to its process: */
+     CHK_MALLOC(scounts, int, np);
+     CHK_MALLOC(sdispls, int, np);
+     CHK_MALLOC(rcounts, int, np);
+     CHK_MALLOC(rdispls, int, np);
+     for (q = 0; q < np; ++q) {
+	  sdispls[q] = cyclic_count(starts[q], me, np);
+	  scounts[q] = cyclic_count(starts[q] + sizes[q], me, np) - sdispls[q];
+	  rcounts[q] = cyclic_count(starts[me] + sizes[me], q, np)
+	       - cyclic_count(starts[me], q, np);
+	  rdispls[q] = q ? rdispls[q-1] + rcounts[q-1] : 0;
+     }
+     CHK_MALLOC(recv, symmetric_matrix, sizes[me]);
+     MPI_Type_contiguous(sizeof(symmetric_matrix) / sizeof(real),
+			 SCALAR_MPI_TYPE, &t);
+     MPI_Type_commit(&t);
+     MPI_Alltoallv(work, scounts, sdispls, t,
+		   recv, rcounts, rdispls, t, mpb_comm);
+     MPI_Type_free(&t);
+
+     /* ...and put them in place: the voxels from process q are those
+	with index % np == q, in increasing order */
+     for (q = 0; q < np; ++q) {
+	  int index = starts[me] + (q - starts[me] % np + np) % np;
+	  for (j = 0; j < rcounts[q]; ++j, index += np)
+	       md->eps_inv[index - starts[me]] = recv[rdispls[q] + j];
+     }
+
+     free(recv);
+     free(rdispls);
+     free(rcounts);
+     free(sdispls);
+     free(scounts);
+     free(work);
+     free(starts);
+     free(sizes);
+}
+#endif /* HAVE_MPI */
+
+/**************************************************************************/
+
+/* The following function initializes the dielectric tensor md->eps_inv,
+   using the dielectric function epsilon(&eps, &eps_inv, r, epsilon_data).
+
+   epsilon is (Kottke) averaged over a rectangular mesh spanning the space
+   between grid points; the size of the mesh is given by mesh_size.
+
+   R[0..2] are the spatial lattice vectors, and are used to convert
+   the discretization grid into spatial coordinates (with the origin
+   at the (0,0,0) grid element.
+
+   In most places, the dielectric tensor is equal to eps_inv, but at
+   dielectric interfaces it varies depending upon the polarization of
+   the field (for faster convergence).  In particular, it depends upon
+   the direction of the field relative to the surface normal vector,
+   so we must compute the latter.  The surface normal is approximated
+   by the "dipole moment" of the dielectric function over a spherical
+   mesh.
+
+   Implementation note: md->eps_inv is chosen to have dimensions matching
+   the output of the FFT.  Thus, its dimensions depend upon whether we are
+   doing a real or complex and serial or parallel FFT. */
+
+void set_maxwell_dielectric(maxwell_data *md,
+			    const int mesh_size[3],
+			    real R[3][3], real G[3][3],
+			    maxwell_dielectric_function epsilon,
+			    maxwell_dielectric_mean_function mepsilon,
+			    void *epsilon_data)
+{
+     voxel_eps_data v;
+     real eps_inv_total = 0.0;
+     int mesh_prod;
+     int n1 = md->nx, n2 = md->ny, n3 = md->nz;
+     int i, j;
+#ifdef HAVE_MPI
+     int local_n2, local_y_start, local_n3;
+#endif
+#ifndef SCALAR_COMPLEX
+     int n_other, n_last;
+#endif
+
+     v.epsilon = epsilon;
+     v.mepsilon = mepsilon;
+     v.epsilon_data = epsilon_data;
+     v.rank = n3 > 1 ? 3 : (n2 > 1 ? 2 : 1);
+     for (i = 0; i < 3; ++i) {
+	  v.mesh_size[i] = mesh_size[i];
+	  for (j = 0; j < 3; ++j)
+	       v.R[i][j] = R[i][j];
+     }
+
+     /* integration mesh for checking whether voxel intersects an interface */
+     get_mesh(mesh_size, v.mesh_center, &mesh_prod); 
+     v.mesh_prod_inv = 1.0 / mesh_prod;
+
+     v.s1 = 1.0 / n1;
+     v.s2 = 1.0 / n2;
+     v.s3 = 1.0 / n3;
+     v.m1 = v.s1 / MAX2(1, mesh_size[0]);
+     v.m2 = v.s2 / MAX2(1, mesh_size[1]);
+     v.m3 = v.s3 / MAX2(1, mesh_size[2]);
+     v.mesh_tol = md->mesh_tolerance;
+
+     /* spherical integration mesh for computing normal vectors */
+     get_moment_mesh(n1, n2, n3, R, G, v.moment_mesh, v.moment_mesh_weights,
+		     &v.size_moment_mesh);
+
+     /* the preconditioner's cached inverse of eps_inv is now stale: */
+     large_free(md->eps_precond);
+     md->eps_precond = NULL;
+
+#ifdef HAVE_MPI
+     set_eps_inv_balanced(md, &v);
+#else
+     LOOP_XYZ(md) {
+	  voxel_eps_inv(md->eps_inv + xyz_index, i1, i2, i3, &v);
+     }}}
+#endif
+
+     for (i = 0; i < md->fft_output_size; ++i)
+	  eps_inv_total += (md->eps_inv[i].m00 +
+			    md->eps_inv[i].m11 +
+			    md->eps_inv[i].m22);
 
      mpi_allreduce_1(&eps_inv_total, real, SCALAR_MPI_TYPE,
 		     MPI_SUM, mpb_comm);
      n1 = md->fft_output_size;
      mpi_allreduce_1(&n1, int, MPI_INT, MPI_SUM, mpb_comm);
      md->eps_inv_mean = eps_inv_total / (3 * n1);
+
+     maxwell_update_band_groups_eps(md);
 }
 
 void set_maxwell_mu(maxwell_data *md,
@@ -790,7 +1237,7 @@ void set_maxwell_mu(maxwell_data *md,
     symmetric_matrix *eps_inv = md->eps_inv;
     real eps_inv_mean = md->eps_inv_mean;
     if (md->mu_inv == NULL) {
-        CHK_MALLOC(md->mu_inv, symmetric_matrix, md->fft_output_size);
+        CHK_LARGE_MALLOC(md->mu_inv, symmetric_matrix, md->fft_output_size);
     }
     /* just re-use code to set epsilon, but initialize mu_inv instead */
     md->eps_inv = md->mu_inv;
@@ -798,4 +1245,5 @@ void set_maxwell_mu(maxwell_data *md,
     md->eps_inv = eps_inv;
     md->mu_inv_mean = md->eps_inv_mean;
     md->eps_inv_mean = eps_inv_mean;
+    maxwell_update_band_groups_eps(md);
 }
@@ -0,0 +1,220 @@
+/* Copyright (C) 1999-2020 Massachusetts Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "config.h"
+#include <check.h>
+
+#include <mpiglue.h>
+#include <mpi_utils.h>
+#include "maxwell.h"
+
+#define MIN2(a,b) ((a) < (b) ? (a) : (b))
+#define MAX2(a,b) ((a) > (b) ? (a) : (b))
+
+/**************************************************************************/
+
+/* Local and projected density of states.  maxwell_accumulate_ldos adds
+   the electric-field energy density u(r) = D*E of each band, normalized
+   so that its integral over the cell (of volume vol) is one, times the
+   weight of the k point, to the bins of the band's frequency:
+
+        LDOS(r,w) = sum over bands and k of weight * K(w - w_n) * u_n(r)
+
+   where K is the normalized indicator function of a bin, or a Gaussian
+   of width broadening integrated over each bin.  Integrating over r, we
+   get the DOS, K(w - w_n) summed over the bands, and, integrating over
+   the points where mask is 1, the projected DOS; only these are computed
+   if the spatial LDOS (nbins arrays of fft_output_size) is not wanted.
+   Like other real scalar fields, the spatial LDOS in an
+   inversion-symmetric (real-field) calculation only stores the points
+   that are not implied by the rfftw output symmetry. */
+
+maxwell_ldos_data *create_maxwell_ldos_data(maxwell_data *md, int nbins,
+					    real fmin, real fmax,
+					    real broadening, int spatial)
+{
+     maxwell_ldos_data *d;
+     int i;
+
+     CHECK(nbins > 0 && fmax > fmin, "invalid LDOS frequency bins");
+     CHECK(broadening >= 0, "negative LDOS broadening");
+
+     CHK_MALLOC(d, maxwell_ldos_data, 1);
+
+     d->d = md;
+     d->nbins = nbins;
+     d->fmin = fmin;
+     d->fmax = fmax;
+     d->broadening = broadening;
+     CHK_MALLOC(d->dos, real, nbins);
+     CHK_MALLOC(d->pdos, real, nbins);
+     for (i = 0; i < nbins; ++i)
+	  d->dos[i] = d->pdos[i] = 0;
+     d->ldos = NULL;
+     if (spatial) {
+	  int N = md->fft_output_size;
+	  CHK_MALLOC(d->ldos, real, nbins * N);
+	  for (i = 0; i < nbins * N; ++i)
+	       d->ldos[i] = 0;
+     }
+     d->mask = NULL;
+
+     return d;
+}
+
+void destroy_maxwell_ldos_data(maxwell_ldos_data *d)
+{
+     if (d) {
+	  free(d->mask);
+	  free(d->ldos);
+	  free(d->pdos);
+	  free(d->dos);
+	  free(d);
+     }
+}
+
+/* Compute the weights kernel[j] (per unit frequency) of a band at
+   frequency freq in the bins j = *jmin..*jmax; returns whether there
+   are any such bins.  The Gaussian is cut off at 5 widths. */
+static int ldos_kernel(maxwell_ldos_data *d, real freq, real *kernel,
+		       int *jmin, int *jmax)
+{
+     real df = (d->fmax - d->fmin) / d->nbins;
+     real a = (freq - d->fmin) / df, w = 5 * d->broadening / df;
+     int j;
+
+     if (a + w < 0 || a - w >= d->nbins)
+	  return 0;
+     *jmin = (int) MAX2(0, floor(a - w));
+     *jmax = (int) MIN2(d->nbins - 1, floor(a + w));
+     if (d->broadening > 0) {
+	  real s = sqrt(2.0) * d->broadening;
+	  for (j = *jmin; j <= *jmax; ++j) {
+	       real f0 = d->fmin + j * df;
+	       kernel[j] = 0.5 * (erf((f0 + df - freq) / s)
+				  - erf((f0 - freq) / s)) / df;
+	  }
+     }
+     else
+	  kernel[*jmin] = 1 / df;
+     return 1;
+}
+
+/* Add the contributions of the bands H, with frequencies freqs, times
+   weight (e.g. 1 / the number of k points), to the (L)DOS.  The D
+   fields are computed num_fft_bands at a time, as in the Maxwell
+   operator; W is scratch space for H_from_B if there is a mu (and may
+   be H otherwise).  The grid points are divided among the threads. */
+void maxwell_accumulate_ldos(maxwell_ldos_data *ld, evectmatrix H,
+			     evectmatrix W, const real *freqs,
+			     real vol, real weight)
+{
+     maxwell_data *md = ld->d;
+     int N, b0, nb, b, jmin, jmax;
+#ifndef SCALAR_COMPLEX
+     int last_dim = md->last_dim, last_dim_stored =
+	  md->last_dim_size / (sizeof(scalar_complex)/sizeof(scalar));
+#endif
+     scalar_complex *cdata;
+     real *kernel;
+
+     N = md->fft_output_size;
+
+     cdata = (scalar_complex *) md->fft_data;
+     CHK_MALLOC(kernel, real, ld->nbins);
+
+     for (b0 = 0; b0 < H.p; b0 += nb) {
+	  nb = MIN2(md->num_fft_bands, H.p - b0);
+	  if (md->mu_inv != NULL)
+	       nb = MIN2(nb, W.alloc_p);
+
+	  /* the D fields of bands b0..b0+nb-1, as in get_dfield: */
+	  if (md->mu_inv == NULL)
+	       maxwell_compute_d_from_H(md, H, cdata, b0, nb);
+	  else {
+	       evectmatrix_resize(&W, nb, 0);
+	       maxwell_compute_H_from_B(md, H, W, cdata, b0, 0, nb);
+	       maxwell_compute_d_from_H(md, W, cdata, 0, nb);
+	       evectmatrix_resize(&W, W.alloc_p, 0);
+	  }
+
+	  for (b = 0; b < nb; ++b) {
+	       real freq = freqs[b0 + b], sums[2], sums2[2];
+	       real scale, sum = 0, psum = 0;
+	       int i, j;
+
+	       if (!ldos_kernel(ld, freq, kernel, &jmin, &jmax))
+		    continue;
+
+	       /* the square of the scale factor of get_dfield: */
+	       scale = 1.0 / (vol * (freq != 0.0 ? freq * freq : 1.0));
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static) private(j) reduction(+:sum,psum)
+#endif
+	       for (i = 0; i < N; ++i) {
+		    const scalar_complex *dp = cdata + 3 * (i * nb + b);
+		    scalar_complex e[3];
+		    real u, count = 1;
+
+		    assign_symmatrix_vector(e, md->eps_inv[i], dp);
+		    u = scale * (e[0].re * dp[0].re + e[0].im * dp[0].im
+				 + e[1].re * dp[1].re + e[1].im * dp[1].im
+				 + e[2].re * dp[2].re + e[2].im * dp[2].im);
+#ifndef SCALAR_COMPLEX
+		    /* most points need to be counted twice, by rfftw
+		       output symmetry (see compute_field_energy_internal): */
+		    {
+			 int last_index;
+#  ifdef HAVE_MPI
+			 if (md->nz == 1) /* 2d: 1st dim. is truncated one */
+			      last_index = i / md->nx + md->local_y_start;
+			 else
+			      last_index = i % last_dim_stored;
+#  else
+			 last_index = i % last_dim_stored;
+#  endif
+			 if (last_index != 0 && 2*last_index != last_dim)
+			      count = 2;
+		    }
+#endif
+		    sum += count * u;
+		    if (ld->mask)
+			 psum += count * ld->mask[i] * u;
+		    if (ld->ldos)
+			 for (j = jmin; j <= jmax; ++j)
+			      ld->ldos[j * N + i] += weight * kernel[j] * u;
+	       }
+
+	       sums[0] = sum; sums[1] = psum;
+	       mpi_allreduce(sums, sums2, 2, real, SCALAR_MPI_TYPE,
+			     MPI_SUM, mpb_comm);
+	       for (j = jmin; j <= jmax; ++j) {
+		    ld->dos[j] += weight * kernel[j];
+		    if (sums2[0] != 0)
+			 ld->pdos[j] += weight * kernel[j]
+			      * sums2[1] / sums2[0];
+	       }
+	  }
+     }
+
+     free(kernel);
+}
@@ -17,6 +17,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "imaxwell.h"
@@ -190,17 +191,17 @@ void maxwell_compute_fft(int dir, maxwell_data *d,
 #    ifdef HAVE_MPI
 	  CHECK(stride==howmany && dist==1, "bug: unsupported stride/dist");
 	  plan = FFTW(mpi_plan_many_dft)(3, np, howmany, 
-					 FFTW_MPI_DEFAULT_BLOCK,
-					 FFTW_MPI_DEFAULT_BLOCK,
+					 MAXWELL_FFT_BLOCK(d, 1),
+					 MAXWELL_FFT_BLOCK(d, 0),
 					 carray_in, carray_out,
-					 mpb_comm, FFTW_BACKWARD,
+					 MAXWELL_FFT_COMM(d), FFTW_BACKWARD,
 					 FFTW_ESTIMATE
 					 | FFTW_MPI_TRANSPOSED_IN);
 	  iplan = FFTW(mpi_plan_many_dft)(3, np, howmany, 
-					  FFTW_MPI_DEFAULT_BLOCK,
-					  FFTW_MPI_DEFAULT_BLOCK,
+					  MAXWELL_FFT_BLOCK(d, 0),
+					  MAXWELL_FFT_BLOCK(d, 1),
 					  carray_in, carray_out,
-					  mpb_comm, FFTW_FORWARD,
+					  MAXWELL_FFT_COMM(d), FFTW_FORWARD,
 					  FFTW_ESTIMATE
 					  | FFTW_MPI_TRANSPOSED_OUT);
 #    else /* !HAVE_MPI */
@@ -219,16 +220,16 @@ void maxwell_compute_fft(int dir, maxwell_data *d,
 #    ifdef HAVE_MPI
 	  CHECK(stride==howmany && dist==1, "bug: unsupported stride/dist");
 	  plan = FFTW(mpi_plan_many_dft_c2r)(rnk, np, howmany, 
-					     FFTW_MPI_DEFAULT_BLOCK,
-					     FFTW_MPI_DEFAULT_BLOCK,
+					     MAXWELL_FFT_BLOCK(d, 1),
+					     MAXWELL_FFT_BLOCK(d, 0),
 					     carray_in, rarray_out,
-					     mpb_comm, FFTW_ESTIMATE
+					     MAXWELL_FFT_COMM(d), FFTW_ESTIMATE
 					     | FFTW_MPI_TRANSPOSED_IN);
 	  iplan = FFTW(mpi_plan_many_dft_r2c)(rnk, np, howmany, 
-					      FFTW_MPI_DEFAULT_BLOCK,
-					      FFTW_MPI_DEFAULT_BLOCK,
+					      MAXWELL_FFT_BLOCK(d, 0),
+					      MAXWELL_FFT_BLOCK(d, 1),
 					      rarray_in, carray_out,
-					      mpb_comm, FFTW_ESTIMATE
+					      MAXWELL_FFT_COMM(d), FFTW_ESTIMATE
 					      | FFTW_MPI_TRANSPOSED_OUT);
 #    else /* !HAVE_MPI */
 	       plan = FFTW(plan_many_dft_c2r)(rnk, n, howmany,
@@ -246,9 +247,9 @@ void maxwell_compute_fft(int dir, maxwell_data *d,
      }
 
      /* note that the new-array execute functions should be safe
-	since we only apply maxwell_compute_fft to fftw_malloc'ed data 
-	(so we don't ever have misaligned arrays), and we check above
-	that the strides etc. match */
+	since we only apply maxwell_compute_fft to large_malloc'ed data
+	(aligned to 64 bytes, so we don't ever have misaligned arrays),
+	and we check above that the strides etc. match */
 #  ifdef SCALAR_COMPLEX
 #    ifdef HAVE_MPI
      FFTW(mpi_execute_dft)(dir < 0 ? plan : iplan, carray_in, carray_out);
@@ -412,17 +413,24 @@ void maxwell_compute_d_from_H(maxwell_data *d, evectmatrix Hin,
      /* first, compute fft_data = curl(Hin) (really (k+G) x H) : */
      for (i = 0; i < d->other_dims; ++i)
 	  for (j = 0; j < d->last_dim; ++j) {
-	       int ij = i * d->last_dim + j;
+	       int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
 	       int ij2 = i * d->last_dim_size + j;
-	       k_data cur_k = d->k_plus_G[ij];
+	       k_data cur_k;
+
+	       if (ij < 0) { /* outside of the planewave cutoff */
+		    for (b = 0; b < 3 * cur_num_bands; ++b)
+			 ASSIGN_ZERO(fft_data_in[3 * ij2 * cur_num_bands + b]);
+		    continue;
+	       }
+	       cur_k = d->k_plus_G[ij];
 	       
 	       for (b = 0; b < cur_num_bands; ++b)
 		    assign_cross_t2c(&fft_data_in[3 * (ij2*cur_num_bands 
 						    + b)], 
 				     cur_k, 
-				     &Hin.data[ij * 2 * Hin.p + 
+				     &Hin.data[ij * 2 * Hin.ld + 
 					      b + cur_band_start],
-				     Hin.p);
+				     Hin.ld);
 	  }
 
      /* now, convert to position space via FFT: */
@@ -489,14 +497,18 @@ void maxwell_compute_H_from_e(maxwell_data *d, evectmatrix Hout,
      
      for (i = 0; i < d->other_dims; ++i)
 	  for (j = 0; j < d->last_dim; ++j) {
-	       int ij = i * d->last_dim + j;
+	       int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
 	       int ij2 = i * d->last_dim_size + j;
-	       k_data cur_k = d->k_plus_G[ij];
+	       k_data cur_k;
+
+	       if (ij < 0)
+		    continue; /* outside of the planewave cutoff */
+	       cur_k = d->k_plus_G[ij];
 	       
 	       for (b = 0; b < cur_num_bands; ++b)
-		    assign_cross_c2t(&Hout.data[ij * 2 * Hout.p + 
+		    assign_cross_c2t(&Hout.data[ij * 2 * Hout.ld + 
 					       b + cur_band_start],
-				     Hout.p, cur_k, 
+				     Hout.ld, cur_k, 
 				     &fft_data_out[3 * (ij2*cur_num_bands+b)],
 				     scale);
 	  }
@@ -523,17 +535,24 @@ void maxwell_compute_h_from_H(maxwell_data *d, evectmatrix Hin,
 	from transverse to cartesian basis: */
      for (i = 0; i < d->other_dims; ++i)
 	  for (j = 0; j < d->last_dim; ++j) {
-	       int ij = i * d->last_dim + j;
+	       int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
 	       int ij2 = i * d->last_dim_size + j;
-               k_data cur_k = d->k_plus_G[ij];
+	       k_data cur_k;
+
+	       if (ij < 0) { /* outside of the planewave cutoff */
+		    for (b = 0; b < 3 * cur_num_bands; ++b)
+			 ASSIGN_ZERO(fft_data_in[3 * ij2 * cur_num_bands + b]);
+		    continue;
+	       }
+	       cur_k = d->k_plus_G[ij];
 	       
 	       for (b = 0; b < cur_num_bands; ++b)
 		    assign_t2c(&fft_data_in[3 * (ij2*cur_num_bands 
 					      + b)], 
 			       cur_k,
-			       &Hin.data[ij * 2 * Hin.p + 
+			       &Hin.data[ij * 2 * Hin.ld + 
 					b + cur_band_start],
-			       Hin.p);
+			       Hin.ld);
 	  }
 
      /* now, convert to position space via FFT: */
@@ -549,7 +568,7 @@ void maxwell_compute_H_from_B(maxwell_data *d, evectmatrix Bin,
      scalar *fft_data = (scalar *) hfield;
      scalar *fft_data_out = d->fft_data2 == d->fft_data ? fft_data : (fft_data == d->fft_data ? d->fft_data2 : d->fft_data);
      int i, j, b;
-     real scale = 1.0 / Hout.N; /* scale factor to normalize FFTs */
+     real scale = 1.0 / d->N; /* scale factor to normalize FFTs */
      
      if (d->mu_inv == NULL) {
          if (Bin.data != Hout.data)
@@ -569,13 +588,17 @@ void maxwell_compute_H_from_B(maxwell_data *d, evectmatrix Bin,
      /* then, compute Hout = (transverse component)(fft_data) * scale factor */
      for (i = 0; i < d->other_dims; ++i)
          for (j = 0; j < d->last_dim; ++j) {
-             int ij = i * d->last_dim + j;
+             int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
              int ij2 = i * d->last_dim_size + j;
-             k_data cur_k = d->k_plus_G[ij];
+             k_data cur_k;
+
+             if (ij < 0)
+                  continue; /* outside of the planewave cutoff */
+             cur_k = d->k_plus_G[ij];
              for (b = 0; b < cur_num_bands; ++b)
-                 project_c2t(&Hout.data[ij * 2 * Hout.p + 
+                 project_c2t(&Hout.data[ij * 2 * Hout.ld + 
                                         b + Hout_band_start],
-                             Hout.p, cur_k, 
+                             Hout.ld, cur_k, 
                                &fft_data_out[3 * (ij2*cur_num_bands+b)],
                              scale);
          }
@@ -630,224 +653,78 @@ void maxwell_compute_H_from_B(maxwell_data *d, evectmatrix Bin,
 
 #define TWOPI 6.2831853071795864769252867665590057683943388
 
-/* This function takes a complex vector field and replaces it with its
-   other "half."  phase{x,y,z} is the phase k*R{x,y,z}, in "units" of
-   2*pi.  (Equivalently, phase{x,y,z} is the k vector in the
-   reciprocal lattice basis.) */
-void maxwell_vectorfield_otherhalf(maxwell_data *d, scalar_complex *field,
-				   real phasex, real phasey, real phasez)
-{
 #ifndef SCALAR_COMPLEX
-     int i, j, jmin = 1;
-     int rank, n_other, n_last, n_last_stored, n_last_new, nx, ny, nz, nxmax;
-#  ifdef HAVE_MPI
-     int local_x_start;
-#  endif
-     scalar_complex pz, pxz, pyz, pxyz;
-
-     nxmax = nx = d->nx; ny = d->ny; nz = d->nz;
-     n_other = d->other_dims;
-     n_last = d->last_dim;
-     n_last_stored = d->last_dim_size / 2;
-     n_last_new = n_last - n_last_stored; /* < n_last_stored always */
-     rank = (nz == 1) ? (ny == 1 ? 1 : 2) : 3;
 
-#  ifdef HAVE_MPI
-     local_x_start = d->local_y_start;
-     CHECK(rank == 2 || rank == 3, "unsupported rfftwnd_mpi rank!");
-     if (rank == 2) {
-	  n_other = nx;
-	  n_last_new = ny = d->local_ny;
-	  if (local_x_start == 0)
-	       --n_last_new; /* DC frequency should not be in other half */
-	  else
-	       jmin = 0;
-	  if (local_x_start + ny == n_last_stored && n_last % 2 == 0)
-	       --n_last_new; /* Nyquist freq. should not be in other half */
-	  n_last_stored = ny;
-     }
-     else { /* rank == 3 */
-	  ny = nx;
-	  nx = d->local_ny;
-	  nxmax = local_x_start ? nx - 1 : nx;
-	  n_other = nx * ny;
-     }
-#  endif /* HAVE_MPI */
+/* Swap the points a and b of a field with nc complex numbers per
+   point, multiplying them by the phase p and conjugating them (which
+   the functions below did in a separate pass), or, if nc == 0, with
+   one real number per point, which is only swapped.  (a == b for the
+   middle point of a row that is its own conjugate.) */
+static void otherhalf_swap(real *a, real *b, int nc, scalar_complex p)
+{
+     int c;
 
-     /* compute p = exp(i*phase) factors: */
-     phasex *= -TWOPI; phasey *= -TWOPI; phasez *= -TWOPI;
-     switch (rank) { /* treat z as the last/truncated dimension always */
-	 case 3: break;
-#  if defined(HAVE_MPI) && ! defined(SCALAR_COMPLEX)
-	 case 2: phasez = phasex; phasex = phasey; phasey = 0; break;
-#  else
-	 case 2: phasez = phasey; phasey = 0; break;
-#  endif
-	 case 1: phasez = phasex; phasex = phasey = 0; break;
+     if (!nc) {
+	  real tmp = *a;
+	  *a = *b;
+	  *b = tmp;
+	  return;
      }
-     CASSIGN_SCALAR(pz, cos(phasez), sin(phasez));
-     phasex += phasez;
-     CASSIGN_SCALAR(pxz, cos(phasex), sin(phasex));
-     phasex += phasey;
-     CASSIGN_SCALAR(pxyz, cos(phasex), sin(phasex));
-     phasey += phasez;
-     CASSIGN_SCALAR(pyz, cos(phasey), sin(phasey));
-
-/* convenience macros to copy vectors, vectors times phases, 
-   and conjugated vectors: */
-#  define ASSIGN_V(f,k,f2,k2) { f[3*(k)+0] = f2[3*(k2)+0];               \
-                                f[3*(k)+1] = f2[3*(k2)+1];               \
-                                f[3*(k)+2] = f2[3*(k2)+2]; }
-#  define ASSIGN_VP(f,k,f2,k2,p) { CASSIGN_MULT(f[3*(k)+0], f2[3*(k2)+0], p); \
-                                   CASSIGN_MULT(f[3*(k)+1], f2[3*(k2)+1], p); \
-                                   CASSIGN_MULT(f[3*(k)+2], f2[3*(k2)+2], p); }
-#  define ASSIGN_CV(f,k,f2,k2) { CASSIGN_CONJ(f[3*(k)+0], f2[3*(k2)+0]); \
-                                 CASSIGN_CONJ(f[3*(k)+1], f2[3*(k2)+1]); \
-                                 CASSIGN_CONJ(f[3*(k)+2], f2[3*(k2)+2]); }
-
-     /* First, swap the order of elements and multiply by exp(ikR)
-        phase factors.  We have to be careful here not to double-swap
-        any element pair; this is prevented by never swapping with a
-        "conjugated" point that is earlier in the array.  */
-
-     if (rank == 3) {
-	  int ix, iy;
-	  for (ix = 0; 2*ix <= nxmax; ++ix) {
-	       int xdiff, ixc;
-#  ifdef HAVE_MPI
-	       if (local_x_start == 0) {
-		    xdiff = ix != 0; ixc = (nx - ix) % nx;
-	       }
-	       else {
-		    xdiff = 1; ixc = nx-1 - ix;
-	       }
-#  else
-	       xdiff = ix != 0; ixc = (nx - ix) % nx;
-#  endif
-	       for (iy = 0; iy < ny; ++iy) {
-		    int ydiff = iy != 0;
-		    int i = ix * ny + iy, ic = ixc * ny + (ny - iy) % ny, jmax;
-		    if (ic < i)
-			 continue;
-		    jmax = n_last_new;
-		    if (ic == i)
-			 jmax = (jmax + 1) / 2;
-		    for (j = 1; j <= jmax; ++j) {
-			 int jc = n_last_new + 1 - j;
-			 int ij = i*n_last_stored + j;
-			 int ijc = ic*n_last_stored + jc;
-			 scalar_complex f_tmp[3];
-			 switch (xdiff*2 + ydiff) { /* pick exp(-ikR) phase */
-			     case 3: /* xdiff && ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pxyz);
-				  ASSIGN_VP(field, ijc, field, ij, pxyz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			     case 2: /* xdiff && !ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pxz);
-				  ASSIGN_VP(field, ijc, field, ij, pxz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			     case 1: /* !xdiff && ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pyz);
-				  ASSIGN_VP(field, ijc, field, ij, pyz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			     case 0: /* !xdiff && !ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pz);
-				  ASSIGN_VP(field, ijc, field, ij, pz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			 }
-		    }
-	       }
-	  }
-
-	  /* Next, conjugate, and remove the holes from the array
-	     corresponding to the DC and Nyquist frequencies (which were in
-	     the first half already): */
-	  for (i = 0; i < n_other; ++i)
-	       for (j = 1; j < n_last_new + 1; ++j) {
-		    int ij = i*n_last_stored + j, ijnew = i*n_last_new + j-1;
-		    ASSIGN_CV(field, ijnew, field, ij);
-	       }
+     for (c = 0; c < 2*nc; c += 2) {
+	  real are = a[c], aim = a[c+1], bre = b[c], bim = b[c+1];
+	  a[c] = p.re * bre - p.im * bim;
+	  a[c+1] = -(p.re * bim + p.im * bre);
+	  b[c] = p.re * are - p.im * aim;
+	  b[c+1] = -(p.re * aim + p.im * are);
      }
-     else /* if (rank <= 2) */ {
-	  int i;
-	  if (rank == 1) /* (note that 1d MPI transforms are not allowed) */
-	       nx = 1; /* x dimension is handled by j (last dimension) loop */
-
-#  ifdef HAVE_MPI
-	  for (i = 0; i < nx; ++i)
-#  else
-	  for (i = 0; 2*i <= nx; ++i)
-#  endif
-	  {
-	       int xdiff = i != 0, ic = (nx - i) % nx;
-	       int jmax = n_last_new + (jmin - 1);
-#  ifndef HAVE_MPI
-	       if (ic == i)
-		    jmax = (jmax + 1) / 2;
-#  endif
-	       for (j = jmin; j <= jmax; ++j) {
-		    scalar_complex f_tmp[3];
-#  ifdef HAVE_MPI
-		    int jc = jmax + jmin - j;
-		    int ij = j * nx + i;
-		    int ijc = jc * nx + ic;
-		    if (ijc < ij)
-			 break;
-#  else  /* ! HAVE_MPI */
-		    int jc = n_last_new + 1 - j;
-		    int ij = i*n_last_stored + j;
-		    int ijc = ic*n_last_stored + jc;
-#  endif /* ! HAVE_MPI */
-		    if (xdiff) {
-			 ASSIGN_VP(f_tmp, 0, field, ijc, pxz);
-			 ASSIGN_VP(field, ijc, field, ij, pxz);
-			 ASSIGN_V(field, ij, f_tmp, 0);
-		    }
-		    else {
-			 ASSIGN_VP(f_tmp, 0, field, ijc, pz);
-			 ASSIGN_VP(field, ijc, field, ij, pz);
-			 ASSIGN_V(field, ij, f_tmp, 0);
-		    }
-	       }
-	  }
+}
 
-	  /* Next, conjugate, and remove the holes from the array
-	     corresponding to the DC and Nyquist frequencies (which were in
-	     the first half already): */
-	  for (i = 0; i < nx; ++i)
-	       for (j = jmin; j < n_last_new + jmin; ++j) {
-#  ifdef HAVE_MPI
-		    int ij = j*nx + i, ijnew = (j-jmin)*nx + i;
-#  else
-		    int ij = i*n_last_stored + j, ijnew = i*n_last_new + j-1;
-#  endif
-		    ASSIGN_CV(field, ijnew, field, ij);
-	       }
+/* Remove the holes from the array corresponding to the DC and Nyquist
+   frequencies (which were in the first half already), moving the
+   n_last_new points (of nr reals each) after the first point of each
+   of the nrows rows of n_last_stored points down to a row of
+   n_last_new points.  This must be done in order, since each row
+   overlaps the rows before it, but all the rows that are moved below
+   the first point not yet read can be moved at once; these groups of
+   rows grow geometrically, and are divided among the threads. */
+static void otherhalf_compact(real *field, int nr, int nrows,
+			      int n_last_stored, int n_last_new)
+{
+     int i0 = 0;
+
+     if (n_last_new <= 0)
+	  return;
+     while (i0 < nrows) {
+	  int i, i1 = (i0 * n_last_stored + 1) / n_last_new;
+	  if (i1 <= i0)
+	       i1 = i0 + 1; /* (memmove handles the overlap within a row) */
+	  if (i1 > nrows)
+	       i1 = nrows;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	  for (i = i0; i < i1; ++i)
+	       memmove(field + nr * (i*n_last_new),
+		       field + nr * (i*n_last_stored + 1),
+		       sizeof(real) * nr * n_last_new);
+	  i0 = i1;
      }
-
-#  undef ASSIGN_V
-#  undef ASSIGN_VP
-#  undef ASSIGN_CV
-
-#endif /* ! SCALAR_COMPLEX */
 }
 
-/* as vectorfield_otherhalf, but operates on a complex scalar field 
-   ... ugh, copy & paste job */
-void maxwell_cscalarfield_otherhalf(maxwell_data *d, scalar_complex *field,
-				    real phasex, real phasey, real phasez)
+/* The common implementation of the functions below, for a field with
+   nc complex numbers per point or, if nc == 0, one real number per
+   point (see otherhalf_swap).  The swaps of different pairs of rows
+   (or of columns, for 2d MPI transforms) are independent, and are
+   divided among the threads. */
+static void field_otherhalf(maxwell_data *d, real *field, int nc,
+			    real phasex, real phasey, real phasez)
 {
-#ifndef SCALAR_COMPLEX
-     int i, j, jmin = 1;
+     int i, jmin = 1, nr = nc ? 2 * nc : 1;
      int rank, n_other, n_last, n_last_stored, n_last_new, nx, ny, nz, nxmax;
 #  ifdef HAVE_MPI
      int local_x_start;
 #  endif
-     scalar_complex pz, pxz, pyz, pxyz;
+     scalar_complex p[4]; /* exp(-ikR) phases, indexed by xdiff*2 + ydiff */
 
      nxmax = nx = d->nx; ny = d->ny; nz = d->nz;
      n_other = d->other_dims;
@@ -882,37 +759,34 @@ void maxwell_cscalarfield_otherhalf(maxwell_data *d, scalar_complex *field,
      phasex *= -TWOPI; phasey *= -TWOPI; phasez *= -TWOPI;
      switch (rank) { /* treat z as the last/truncated dimension always */
 	 case 3: break;
-#  if defined(HAVE_MPI) && ! defined(SCALAR_COMPLEX)
+#  ifdef HAVE_MPI
 	 case 2: phasez = phasex; phasex = phasey; phasey = 0; break;
 #  else
 	 case 2: phasez = phasey; phasey = 0; break;
 #  endif
 	 case 1: phasez = phasex; phasex = phasey = 0; break;
      }
-     CASSIGN_SCALAR(pz, cos(phasez), sin(phasez));
+     CASSIGN_SCALAR(p[0], cos(phasez), sin(phasez));
      phasex += phasez;
-     CASSIGN_SCALAR(pxz, cos(phasex), sin(phasex));
+     CASSIGN_SCALAR(p[2], cos(phasex), sin(phasex));
      phasex += phasey;
-     CASSIGN_SCALAR(pxyz, cos(phasex), sin(phasex));
+     CASSIGN_SCALAR(p[3], cos(phasex), sin(phasex));
      phasey += phasez;
-     CASSIGN_SCALAR(pyz, cos(phasey), sin(phasey));
+     CASSIGN_SCALAR(p[1], cos(phasey), sin(phasey));
 
-/* convenience macros to copy cscalars, cscalars times phases, 
-   and conjugated cscalars (THIS IS THE ONLY CODE THAT WAS CHANGED
-   COMPARED TO vectorfield_otherhalf): */
-#  define ASSIGN_V(f,k,f2,k2) { f[k] = f2[k2]; }
-#  define ASSIGN_VP(f,k,f2,k2,p) { CASSIGN_MULT(f[k], f2[k2], p); }
-#  define ASSIGN_CV(f,k,f2,k2) { CASSIGN_CONJ(f[k], f2[k2]); }
-
-     /* First, swap the order of elements and multiply by exp(ikR)
-        phase factors.  We have to be careful here not to double-swap
-        any element pair; this is prevented by never swapping with a
-        "conjugated" point that is earlier in the array.  */
+     /* First, swap the order of elements, multiply by exp(ikR) phase
+        factors, and conjugate.  We have to be careful here not to
+        double-swap any element pair; this is prevented by never
+        swapping with a "conjugated" point that is earlier in the
+        array.  */
 
      if (rank == 3) {
-	  int ix, iy;
-	  for (ix = 0; 2*ix <= nxmax; ++ix) {
-	       int xdiff, ixc;
+	  int nxy = (nxmax / 2 + 1) * ny; /* i = ix*ny + iy with 2*ix <= nxmax */
+#  ifdef USE_OPENMP
+#  pragma omp parallel for schedule(static)
+#  endif
+	  for (i = 0; i < nxy; ++i) {
+	       int ix = i / ny, iy = i % ny, xdiff, ixc, ic, j, jmax;
 #  ifdef HAVE_MPI
 	       if (local_x_start == 0) {
 		    xdiff = ix != 0; ixc = (nx - ix) % nx;
@@ -923,73 +797,43 @@ void maxwell_cscalarfield_otherhalf(maxwell_data *d, scalar_complex *field,
 #  else
 	       xdiff = ix != 0; ixc = (nx - ix) % nx;
 #  endif
-	       for (iy = 0; iy < ny; ++iy) {
-		    int ydiff = iy != 0;
-		    int i = ix * ny + iy, ic = ixc * ny + (ny - iy) % ny, jmax;
-		    if (ic < i)
-			 continue;
-		    jmax = n_last_new;
-		    if (ic == i)
-			 jmax = (jmax + 1) / 2;
-		    for (j = 1; j <= jmax; ++j) {
-			 int jc = n_last_new + 1 - j;
-			 int ij = i*n_last_stored + j;
-			 int ijc = ic*n_last_stored + jc;
-			 scalar_complex f_tmp[3];
-			 switch (xdiff*2 + ydiff) { /* pick exp(-ikR) phase */
-			     case 3: /* xdiff && ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pxyz);
-				  ASSIGN_VP(field, ijc, field, ij, pxyz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			     case 2: /* xdiff && !ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pxz);
-				  ASSIGN_VP(field, ijc, field, ij, pxz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			     case 1: /* !xdiff && ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pyz);
-				  ASSIGN_VP(field, ijc, field, ij, pyz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			     case 0: /* !xdiff && !ydiff */
-				  ASSIGN_VP(f_tmp, 0, field, ijc, pz);
-				  ASSIGN_VP(field, ijc, field, ij, pz);
-				  ASSIGN_V(field, ij, f_tmp, 0);
-				  break;
-			 }
-		    }
+	       ic = ixc * ny + (ny - iy) % ny;
+	       if (ic < i)
+		    continue;
+	       jmax = n_last_new;
+	       if (ic == i)
+		    jmax = (jmax + 1) / 2;
+	       for (j = 1; j <= jmax; ++j) {
+		    int jc = n_last_new + 1 - j;
+		    otherhalf_swap(field + nr * (i*n_last_stored + j),
+				   field + nr * (ic*n_last_stored + jc),
+				   nc, p[xdiff*2 + (iy != 0)]);
 	       }
 	  }
-
-	  /* Next, conjugate, and remove the holes from the array
-	     corresponding to the DC and Nyquist frequencies (which were in
-	     the first half already): */
-	  for (i = 0; i < n_other; ++i)
-	       for (j = 1; j < n_last_new + 1; ++j) {
-		    int ij = i*n_last_stored + j, ijnew = i*n_last_new + j-1;
-		    ASSIGN_CV(field, ijnew, field, ij);
-	       }
+	  otherhalf_compact(field, nr, n_other, n_last_stored, n_last_new);
      }
      else /* if (rank <= 2) */ {
-	  int i;
+	  int imax;
 	  if (rank == 1) /* (note that 1d MPI transforms are not allowed) */
 	       nx = 1; /* x dimension is handled by j (last dimension) loop */
 
 #  ifdef HAVE_MPI
-	  for (i = 0; i < nx; ++i)
+	  imax = nx - 1;
 #  else
-	  for (i = 0; 2*i <= nx; ++i)
+	  imax = nx / 2;
 #  endif
-	  {
-	       int xdiff = i != 0, ic = (nx - i) % nx;
+#  ifdef USE_OPENMP
+#  pragma omp parallel for schedule(static)
+#  endif
+	  for (i = 0; i <= imax; ++i) {
+	       int ic = (nx - i) % nx, j;
 	       int jmax = n_last_new + (jmin - 1);
+	       scalar_complex pix = p[(i != 0) * 2];
 #  ifndef HAVE_MPI
 	       if (ic == i)
 		    jmax = (jmax + 1) / 2;
 #  endif
 	       for (j = jmin; j <= jmax; ++j) {
-		    scalar_complex f_tmp[3];
 #  ifdef HAVE_MPI
 		    int jc = jmax + jmin - j;
 		    int ij = j * nx + i;
@@ -1001,38 +845,42 @@ void maxwell_cscalarfield_otherhalf(maxwell_data *d, scalar_complex *field,
 		    int ij = i*n_last_stored + j;
 		    int ijc = ic*n_last_stored + jc;
 #  endif /* ! HAVE_MPI */
-		    if (xdiff) {
-			 ASSIGN_VP(f_tmp, 0, field, ijc, pxz);
-			 ASSIGN_VP(field, ijc, field, ij, pxz);
-			 ASSIGN_V(field, ij, f_tmp, 0);
-		    }
-		    else {
-			 ASSIGN_VP(f_tmp, 0, field, ijc, pz);
-			 ASSIGN_VP(field, ijc, field, ij, pz);
-			 ASSIGN_V(field, ij, f_tmp, 0);
-		    }
+		    otherhalf_swap(field + nr * ij, field + nr * ijc, nc, pix);
 	       }
 	  }
 
-	  /* Next, conjugate, and remove the holes from the array
-	     corresponding to the DC and Nyquist frequencies (which were in
-	     the first half already): */
-	  for (i = 0; i < nx; ++i)
-	       for (j = jmin; j < n_last_new + jmin; ++j) {
 #  ifdef HAVE_MPI
-		    int ij = j*nx + i, ijnew = (j-jmin)*nx + i;
+	  /* the rows are in the (transposed) first dimension here: */
+	  if (jmin && n_last_new > 0)
+	       memmove(field, field + nr * nx,
+		       sizeof(real) * nr * nx * n_last_new);
 #  else
-		    int ij = i*n_last_stored + j, ijnew = i*n_last_new + j-1;
+	  otherhalf_compact(field, nr, nx, n_last_stored, n_last_new);
 #  endif
-		    ASSIGN_CV(field, ijnew, field, ij);
-	       }
      }
-
-#  undef ASSIGN_V
-#  undef ASSIGN_VP
-#  undef ASSIGN_CV
+}
 
 #endif /* ! SCALAR_COMPLEX */
+
+/* This function takes a complex vector field and replaces it with its
+   other "half."  phase{x,y,z} is the phase k*R{x,y,z}, in "units" of
+   2*pi.  (Equivalently, phase{x,y,z} is the k vector in the
+   reciprocal lattice basis.) */
+void maxwell_vectorfield_otherhalf(maxwell_data *d, scalar_complex *field,
+				   real phasex, real phasey, real phasez)
+{
+#ifndef SCALAR_COMPLEX
+     field_otherhalf(d, (real *) field, 3, phasex, phasey, phasez);
+#endif
+}
+
+/* as vectorfield_otherhalf, but operates on a complex scalar field */
+void maxwell_cscalarfield_otherhalf(maxwell_data *d, scalar_complex *field,
+				    real phasex, real phasey, real phasez)
+{
+#ifndef SCALAR_COMPLEX
+     field_otherhalf(d, (real *) field, 1, phasex, phasey, phasez);
+#endif
 }
 
 /* Similar to vectorfield_otherhalf, above, except that it operates on
@@ -1042,142 +890,116 @@ void maxwell_cscalarfield_otherhalf(maxwell_data *d, scalar_complex *field,
 void maxwell_scalarfield_otherhalf(maxwell_data *d, real *field)
 {
 #ifndef SCALAR_COMPLEX
-     int i, j, jmin = 1;
-     int rank, n_other, n_last, n_last_stored, n_last_new, nx, ny, nz, nxmax;
-#  ifdef HAVE_MPI
-     int local_x_start;
-#  endif
+     field_otherhalf(d, field, 0, 0, 0, 0);
+#endif
+}
 
-     nxmax = nx = d->nx; ny = d->ny; nz = d->nz;
-     n_other = d->other_dims;
-     n_last = d->last_dim;
-     n_last_stored = d->last_dim_size / 2;
-     n_last_new = n_last - n_last_stored; /* < n_last_stored always */
-     rank = (nz == 1) ? (ny == 1 ? 1 : 2) : 3;
+/**************************************************************************/
 
-#  ifdef HAVE_MPI
-     local_x_start = d->local_y_start;
-     CHECK(rank == 2 || rank == 3, "unsupported rfftwnd_mpi rank!");
-     if (rank == 2) {
-	  n_other = nx;
-	  n_last_new = ny = d->local_ny;
-	  if (local_x_start == 0)
-	       --n_last_new; /* DC frequency should not be in other half */
-	  else
-	       jmin = 0;
-	  if (local_x_start + ny == n_last_stored && n_last % 2 == 0)
-	       --n_last_new; /* Nyquist freq. should not be in other half */
-	  n_last_stored = ny;
+#define MIN2(a,b) ((a) < (b) ? (a) : (b))
+#define MAX2(a,b) ((a) > (b) ? (a) : (b))
+
+/* With band groups (see maxwell_set_band_groups), the bands of X are
+   divided into d->band_groups chunks, and chunk i goes to the i-th
+   process in our column of the process grid.
+   maxwell_band_groups_begin transposes X (with the other processes
+   in our column) to return our chunk of the bands in the thicker
+   slab of d->band_data, and maxwell_band_groups_end does the
+   reverse, writing the chunks of all the processes in the column
+   back into X.  Xt is a scratch matrix, overwritten by the next call
+   to maxwell_band_groups_begin. */
+
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+#  define BAND_CHUNK_START(X, g, i) (((X).p * (i)) / (g))
+#endif
+
+evectmatrix maxwell_band_groups_begin(maxwell_data *d, evectmatrix X)
+{
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+     maxwell_band_groups *g = (maxwell_band_groups *) d->band_groups_data;
+     maxwell_data *bd = (maxwell_data *) d->band_data;
+     int i, nb, nbt, rows, in, ib;
+
+     CHECK(g && X.localN == d->local_N, "bug: invalid band groups data");
+
+     /* allocate the send buffer and Xt: */
+     if (g->buf_size < X.n * X.p) {
+	  free(g->buf);
+	  g->buf_size = X.n * X.p;
+	  CHK_MALLOC(g->buf, scalar, g->buf_size);
      }
-     else { /* rank == 3 */
-	  ny = nx;
-	  nx = d->local_ny;
-	  nxmax = local_x_start ? nx - 1 : nx;
-	  n_other = nx * ny;
+     nbt = BAND_CHUNK_START(X, d->band_groups, g->band_rank + 1)
+	  - BAND_CHUNK_START(X, d->band_groups, g->band_rank);
+     if (!g->Xt.data || g->Xt.alloc_p < nbt
+	 || g->Xt.localN != bd->local_N) {
+	  if (g->Xt.data)
+	       destroy_evectmatrix(g->Xt);
+	  g->Xt = create_evectmatrix(bd->N, X.c, MAX2(1, nbt), bd->local_N,
+				     bd->N_start, bd->alloc_N);
      }
-#  endif /* HAVE_MPI */
-
-     /* First, swap the order of elements and multiply by exp(ikR)
-        phase factors.  We have to be careful here not to double-swap
-        any element pair; this is prevented by never swapping with a
-        "conjugated" point that is earlier in the array.  */
-
-     if (rank == 3) {
-	  int ix, iy;
-	  for (ix = 0; 2*ix <= nxmax; ++ix) {
-	       int ixc;
-#  ifdef HAVE_MPI
-	       if (local_x_start == 0)
-		    ixc = (nx - ix) % nx;
-	       else
-		    ixc = nx-1 - ix;
-#  else
-	       ixc = (nx - ix) % nx;
-#  endif
-	       for (iy = 0; iy < ny; ++iy) {
-		    int i = ix * ny + iy, ic = ixc * ny + (ny - iy) % ny, jmax;
-		    if (ic < i)
-			 continue;
-		    jmax = n_last_new;
-		    if (ic == i)
-			 jmax = (jmax + 1) / 2;
-		    for (j = 1; j <= jmax; ++j) {
-			 int jc = n_last_new + 1 - j;
-			 int ij = i*n_last_stored + j;
-			 int ijc = ic*n_last_stored + jc;
-			 real f_tmp;
-			 f_tmp = field[ijc];
-			 field[ijc] = field[ij];
-			 field[ij] = f_tmp;
-		    }
-	       }
-	  }
-
-	  /* Next, conjugate, and remove the holes from the array
-	     corresponding to the DC and Nyquist frequencies (which were in
-	     the first half already): */
-	  for (i = 0; i < n_other; ++i)
-	       for (j = 1; j < n_last_new + 1; ++j) {
-		    int ij = i*n_last_stored + j, ijnew = i*n_last_new + j-1;
-		    field[ijnew] = field[ij];
-	       }
+     evectmatrix_resize(&g->Xt, nbt, 0);
+
+     /* pack chunk i of the bands contiguously for process i, and
+	receive our chunk of the rows of process i, which are at an
+	offset within the slab of band_data given by the rows of the
+	preceding processes in the column: */
+     for (i = rows = 0; i < d->band_groups; ++i) {
+	  int b0 = BAND_CHUNK_START(X, d->band_groups, i);
+	  nb = BAND_CHUNK_START(X, d->band_groups, i + 1) - b0;
+	  for (in = 0; in < X.n; ++in)
+	       for (ib = 0; ib < nb; ++ib)
+		    g->buf[X.n * b0 + in * nb + ib] = X.data[in * X.ld + b0 + ib];
+	  g->counts[i] = X.n * nb * SCALAR_NUMVALS;
+	  g->displs[i] = X.n * b0 * SCALAR_NUMVALS;
+	  g->rcounts[i] = g->local_N[i] * X.c * nbt * SCALAR_NUMVALS;
+	  g->rdispls[i] = rows * X.c * nbt * SCALAR_NUMVALS;
+	  rows += g->local_N[i];
      }
-     else /* if (rank <= 2) */ {
-	  int i;
-	  if (rank == 1) /* (note that 1d MPI transforms are not allowed) */
-	       nx = 1; /* x dimension is handled by j (last dimension) loop */
-
-#  ifdef HAVE_MPI
-	  for (i = 0; i < nx; ++i)
-#  else
-	  for (i = 0; 2*i <= nx; ++i)
-#  endif
-	  {
-	       int ic = (nx - i) % nx;
-	       int jmax = n_last_new + (jmin - 1);
-#  ifndef HAVE_MPI
-	       if (ic == i)
-		    jmax = (jmax + 1) / 2;
-#  endif
-	       for (j = jmin; j <= jmax; ++j) {
-		    real f_tmp;
-#  ifdef HAVE_MPI
-		    int jc = jmax + jmin - j;
-		    int ij = j * nx + i;
-		    int ijc = jc * nx + ic;
-		    if (ijc < ij)
-			 break;
-#  else  /* ! HAVE_MPI */
-		    int jc = n_last_new + 1 - j;
-		    int ij = i*n_last_stored + j;
-		    int ijc = ic*n_last_stored + jc;
-#  endif /* ! HAVE_MPI */
-		    f_tmp = field[ijc];
-		    field[ijc] = field[ij];
-		    field[ij] = f_tmp;
-	       }
-	  }
+     MPI_Alltoallv(g->buf, g->counts, g->displs, SCALAR_MPI_TYPE,
+		   g->Xt.data, g->rcounts, g->rdispls, SCALAR_MPI_TYPE,
+		   g->band_comm);
+     return g->Xt;
+#else
+     (void) d;
+     CHECK(0, "band groups require MPI and FFTW3");
+     return X;
+#endif
+}
 
-	  /* Next, remove the holes from the array corresponding to
-	     the DC and Nyquist frequencies (which were in the first
-	     half already): */
-	  for (i = 0; i < nx; ++i)
-	       for (j = jmin; j < n_last_new + jmin; ++j) {
-#  ifdef HAVE_MPI
-		    int ij = j*nx + i, ijnew = (j-jmin)*nx + i;
-#  else
-		    int ij = i*n_last_stored + j, ijnew = i*n_last_new + j-1;
-#  endif
-		    field[ijnew] = field[ij];
-	       }
+void maxwell_band_groups_end(maxwell_data *d, evectmatrix Xt, evectmatrix X)
+{
+#if defined(HAVE_MPI) && defined(HAVE_FFTW3)
+     maxwell_band_groups *g = (maxwell_band_groups *) d->band_groups_data;
+     int i, nb, rows, in, ib;
+
+     /* the exact reverse of maxwell_band_groups_begin: */
+     for (i = rows = 0; i < d->band_groups; ++i) {
+	  int b0 = BAND_CHUNK_START(X, d->band_groups, i);
+	  nb = BAND_CHUNK_START(X, d->band_groups, i + 1) - b0;
+	  g->counts[i] = g->local_N[i] * X.c * Xt.p * SCALAR_NUMVALS;
+	  g->displs[i] = rows * X.c * Xt.p * SCALAR_NUMVALS;
+	  g->rcounts[i] = X.n * nb * SCALAR_NUMVALS;
+	  g->rdispls[i] = X.n * b0 * SCALAR_NUMVALS;
+	  rows += g->local_N[i];
      }
-#endif /* ! SCALAR_COMPLEX */
+     MPI_Alltoallv(Xt.data, g->counts, g->displs, SCALAR_MPI_TYPE,
+		   g->buf, g->rcounts, g->rdispls, SCALAR_MPI_TYPE,
+		   g->band_comm);
+     for (i = 0; i < d->band_groups; ++i) {
+	  int b0 = BAND_CHUNK_START(X, d->band_groups, i);
+	  nb = BAND_CHUNK_START(X, d->band_groups, i + 1) - b0;
+	  for (in = 0; in < X.n; ++in)
+	       for (ib = 0; ib < nb; ++ib)
+		    X.data[in * X.ld + b0 + ib] = g->buf[X.n * b0 + in * nb + ib];
+     }
+#else
+     (void) d; (void) Xt; (void) X;
+     CHECK(0, "band groups require MPI and FFTW3");
+#endif
 }
 
 /**************************************************************************/
 
-#define MIN2(a,b) ((a) < (b) ? (a) : (b))
-
 /* Compute Xout = 1/mu curl(1/epsilon * curl(Xin)) 1/mu */
 void maxwell_operator(evectmatrix Xin, evectmatrix Xout, void *data,
 		      int is_current_eigenvector, evectmatrix Work)
@@ -1193,8 +1015,16 @@ void maxwell_operator(evectmatrix Xin, evectmatrix Xout, void *data,
      (void) is_current_eigenvector;  /* unused */
      (void) Work;
 
+     if (d->band_groups > 1) {
+	  evectmatrix Xt = maxwell_band_groups_begin(d, Xin);
+	  maxwell_operator(Xt, Xt, d->band_data, is_current_eigenvector,
+			   Work);
+	  maxwell_band_groups_end(d, Xt, Xout);
+	  return;
+     }
+
      cdata = (scalar_complex *) d->fft_data;
-     scale = -1.0 / Xout.N;  /* scale factor to normalize FFT; 
+     scale = -1.0 / d->N;  /* scale factor to normalize FFT; 
 				negative sign comes from 2 i's from curls */
 
      /* compute the operator, num_fft_bands at a time: */
@@ -1233,6 +1063,14 @@ void maxwell_muinv_operator(evectmatrix Xin, evectmatrix Xout, void *data,
     
     (void) is_current_eigenvector;  /* unused */
     (void) Work;
+
+    if (d->band_groups > 1) {
+	 evectmatrix Xt = maxwell_band_groups_begin(d, Xin);
+	 maxwell_muinv_operator(Xt, Xt, d->band_data,
+				is_current_eigenvector, Work);
+	 maxwell_band_groups_end(d, Xt, Xout);
+	 return;
+    }
     
     cdata = (scalar_complex *) d->fft_data;
 
@@ -1299,7 +1137,7 @@ void maxwell_ucross_op(evectmatrix Xin, evectmatrix Xout,
      cdata = (scalar_complex *) (fft_data = d->fft_data);
      fft_data_in = d->fft_data2;
 
-     scale = -1.0 / Xout.N;  /* scale factor to normalize FFT;
+     scale = -1.0 / d->N;  /* scale factor to normalize FFT;
                                 negative sign comes from 2 i's from curls */
 
      /* compute the operator, num_fft_bands at a time: */
@@ -1310,17 +1148,24 @@ void maxwell_ucross_op(evectmatrix Xin, evectmatrix Xout,
 	  /* first, compute fft_data = u x Xin: */
 	  for (i = 0; i < d->other_dims; ++i)
 	       for (j = 0; j < d->last_dim; ++j) {
-		    int ij = i * d->last_dim + j;
+		    int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
 		    int ij2 = i * d->last_dim_size + j;
-		    k_data cur_k = d->k_plus_G[ij];
+		    k_data cur_k;
+
+		    if (ij < 0) { /* outside of the planewave cutoff */
+			 for (b = 0; b < 3 * cur_num_bands; ++b)
+			      ASSIGN_ZERO(fft_data_in[3 * ij2 * cur_num_bands + b]);
+			 continue;
+		    }
+		    cur_k = d->k_plus_G[ij];
 		    
 		    for (b = 0; b < cur_num_bands; ++b)
 			 assign_ucross_t2c(&fft_data_in[3 * (ij2*cur_num_bands
 							  + b)], 
 					   u, cur_k, 
-					   &Xin.data[ij * 2 * Xin.p + 
+					   &Xin.data[ij * 2 * Xin.ld + 
 						    b + cur_band_start],
-					   Xin.p);
+					   Xin.ld);
 	       }
 	  
 	  /* now, convert to position space via FFT: */
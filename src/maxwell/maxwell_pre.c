@@ -23,6 +23,7 @@
 #include <check.h>
 
 #include <mpiglue.h>
+#include <large_malloc.h>
 #include "maxwell.h"
 
 #define PRECOND_SUBTR_EIGS 0
@@ -48,7 +49,7 @@ void maxwell_simple_precondition(evectmatrix X, void *data, real *eigenvals)
      for (i = 0; i < X.localN; ++i) {
 	  for (c = 0; c < X.c; ++c) {
 	       for (b = 0; b < X.p; ++b) {
-		    int index = (i * X.c + c) * X.p + b;
+		    int index = (i * X.c + c) * X.ld + b;
 		    real scale = kpGn2[i] * d->eps_inv_mean;
 
 #if PRECOND_SUBTR_EIGS
@@ -103,7 +104,7 @@ void maxwell_target_preconditioner(evectmatrix Xin, evectmatrix Xout,
      for (i = 0; i < Xout.localN; ++i) {
 	  for (c = 0; c < Xout.c; ++c) {
 	       for (b = 0; b < Xout.p; ++b) {
-		    int index = (i * Xout.c + c) * Xout.p + b;
+		    int index = (i * Xout.c + c) * Xout.ld + b;
 		    real scale = kpGn2[i] * d->eps_inv_mean;
 
 #if PRECOND_SUBTR_EIGS
@@ -229,13 +230,29 @@ void maxwell_preconditioner2(evectmatrix Xin, evectmatrix Xout, void *data,
      if (Xout.data != Xin.data)
 	  evectmatrix_XeYS(Xout, Xin, YtY, 1);
 
+     if (d->band_groups > 1) {
+	  evectmatrix Xt = maxwell_band_groups_begin(d, Xout);
+	  maxwell_data *bd = (maxwell_data *) d->band_data;
+	  bd->precond_eps_tensor = d->precond_eps_tensor;
+	  maxwell_preconditioner2(Xt, Xt, bd, Y, eigenvals, YtY);
+	  maxwell_band_groups_end(d, Xt, Xout);
+	  return;
+     }
+
      fft_data = d->fft_data;
      fft_data2 = d->fft_data2;
      cdata = (scalar_complex *) fft_data;
 
-     scale = -1.0 / Xout.N;  /* scale factor to normalize FFT;
+     scale = -1.0 / d->N;  /* scale factor to normalize FFT;
                                 negative sign comes from 2 i's from curls */
 
+     if (d->precond_eps_tensor && !d->eps_precond) {
+	  CHK_LARGE_MALLOC(d->eps_precond, symmetric_matrix,
+			   d->fft_output_size);
+	  for (i = 0; i < d->fft_output_size; ++i)
+	       maxwell_sym_matrix_invert(&d->eps_precond[i], &d->eps_inv[i]);
+     }
+
      for (cur_band_start = 0; cur_band_start < Xout.p;
           cur_band_start += d->num_fft_bands) {
           int cur_num_bands = MIN2(d->num_fft_bands, Xout.p - cur_band_start);
@@ -245,17 +262,24 @@ void maxwell_preconditioner2(evectmatrix Xin, evectmatrix Xout, void *data,
 
 	  for (i = 0; i < d->other_dims; ++i)
 	       for (j = 0; j < d->last_dim; ++j) {
-		    int ij = i * d->last_dim + j;
+		    int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
 		    int ij2 = i * d->last_dim_size + j;
-		    k_data cur_k = d->k_plus_G[ij];
+		    k_data cur_k;
+
+		    if (ij < 0) { /* outside of the planewave cutoff */
+			 for (b = 0; b < 3 * cur_num_bands; ++b)
+			      ASSIGN_ZERO(fft_data2[3 * ij2 * cur_num_bands + b]);
+			 continue;
+		    }
+		    cur_k = d->k_plus_G[ij];
 		    
 		    for (b = 0; b < cur_num_bands; ++b)
 			 assign_crossinv_t2c(&fft_data2[3 * (ij2*cur_num_bands
 							    + b)],
 					     cur_k,
-					     &Xout.data[ij * 2 * Xout.p +
+					     &Xout.data[ij * 2 * Xout.ld +
 						      b + cur_band_start],
-					     Xout.p);
+					     Xout.ld);
 	       }
 
 	  /********************************************/
@@ -265,10 +289,19 @@ void maxwell_preconditioner2(evectmatrix Xin, evectmatrix Xout, void *data,
 	  maxwell_compute_fft(+1, d, fft_data2, fft_data,
 			      cur_num_bands*3, cur_num_bands*3, 1);
 
-	  /* multiply by epsilon in position space.  Don't bother to
-	     invert the whole epsilon-inverse tensor; just take the
-	     inverse of the average epsilon-inverse (= trace / 3). */
-	  for (i = 0; i < d->fft_output_size; ++i) {
+	  /* multiply by epsilon in position space.  By default, don't
+	     bother to invert the whole epsilon-inverse tensor; just take
+	     the inverse of the average epsilon-inverse (= trace / 3).
+	     The full local tensor is better at high-contrast interfaces,
+	     where the averaged eps_inv is strongly anisotropic. */
+	  if (d->precond_eps_tensor)
+	       for (i = 0; i < d->fft_output_size; ++i)
+		    for (b = 0; b < cur_num_bands; ++b) {
+			 int ib = 3 * (i * cur_num_bands + b);
+			 assign_symmatrix_vector(&cdata[ib], d->eps_precond[i],
+						 &cdata[ib]);
+		    }
+	  else for (i = 0; i < d->fft_output_size; ++i) {
 	       symmetric_matrix eps_inv = d->eps_inv[i];
 	       real eps = 3.0 / (eps_inv.m00 + eps_inv.m11 + eps_inv.m22);
 	       for (b = 0; b < cur_num_bands; ++b) {
@@ -291,14 +324,18 @@ void maxwell_preconditioner2(evectmatrix Xin, evectmatrix Xout, void *data,
 
           for (i = 0; i < d->other_dims; ++i)
                for (j = 0; j < d->last_dim; ++j) {
-                    int ij = i * d->last_dim + j;
+                    int ij = MAXWELL_PLANEWAVE(d, i * d->last_dim + j);
                     int ij2 = i * d->last_dim_size + j;
-                    k_data cur_k = d->k_plus_G[ij];
+                    k_data cur_k;
+
+                    if (ij < 0)
+                         continue; /* outside of the planewave cutoff */
+                    cur_k = d->k_plus_G[ij];
 
                     for (b = 0; b < cur_num_bands; ++b)
-                         assign_crossinv_c2t(&Xout.data[ij * 2 * Xout.p +
+                         assign_crossinv_c2t(&Xout.data[ij * 2 * Xout.ld +
 						       b + cur_band_start],
-					     Xout.p,
+					     Xout.ld,
 					     cur_k,
 					     &fft_data2[3 * (ij2*cur_num_bands
 							    + b)],
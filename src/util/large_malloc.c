@@ -0,0 +1,230 @@
+/* Copyright (C) 1999-2020 Massachusetts Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include <check.h>
+#include <mpiglue.h>
+
+#include "mpi_utils.h"
+#include "large_malloc.h"
+
+#if defined(HAVE_SYS_MMAN_H)
+#  include <sys/mman.h>
+#endif
+#if defined(HAVE_NUMAIF_H) && defined(HAVE_LIBNUMA)
+#  include <numaif.h>
+#  define HAVE_MOVE_PAGES 1
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+int mpb_huge_pages = LARGE_MALLOC_NO_HUGE_PAGES;
+
+#define SMALL_PAGE_SIZE 4096
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Each array is preceded by a header (padded to the alignment of the
+   array), which records how to free it, and links it into a list of
+   the live arrays for large_malloc_report. */
+typedef struct large_header_s {
+     size_t n, map_size; /* map_size > 0 if allocated by mmap */
+     size_t page_size; /* granularity of the first touch */
+     int huge; /* LARGE_MALLOC_*_HUGE_PAGES used for this array */
+     struct large_header_s *prev, *next;
+} large_header;
+
+#define HEADER_SIZE 64 /* >= sizeof(large_header), a multiple of 64 */
+
+static large_header *large_arrays = NULL;
+
+/* Zero the n bytes at p, a page at a time, with the pages divided
+   among the threads in contiguous chunks by a static schedule, the
+   same as the loops and the threaded FFTs over these arrays, so that
+   each page is placed on the NUMA node of the thread using it. */
+static void first_touch(char *p, size_t n, size_t page_size)
+{
+     int i, npages = (int) ((n + page_size - 1) / page_size);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+     for (i = 0; i < npages; ++i) {
+	  size_t start = page_size * i;
+	  memset(p + start, 0, n - start < page_size ? n - start : page_size);
+     }
+}
+
+void *large_malloc(size_t n)
+{
+     char *base = NULL;
+     large_header h;
+
+     if (n == 0)
+	  return NULL;
+
+     h.n = n;
+     h.map_size = 0;
+     h.page_size = SMALL_PAGE_SIZE;
+     h.huge = LARGE_MALLOC_NO_HUGE_PAGES;
+
+     /* huge pages are only worth it for arrays of at least one page */
+#if !defined(DEBUG_MALLOC) && defined(HAVE_SYS_MMAN_H)
+     if (mpb_huge_pages != LARGE_MALLOC_NO_HUGE_PAGES
+	 && n + HEADER_SIZE >= HUGE_PAGE_SIZE) {
+	  size_t size = ((n + HEADER_SIZE + HUGE_PAGE_SIZE - 1)
+			 / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+#  ifdef MAP_HUGETLB
+	  if (mpb_huge_pages == LARGE_MALLOC_EXPLICIT_HUGE_PAGES) {
+	       void *m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+			      -1, 0);
+	       if (m != MAP_FAILED) { /* else fall back to transparent */
+		    base = (char *) m;
+		    h.map_size = size;
+		    h.huge = LARGE_MALLOC_EXPLICIT_HUGE_PAGES;
+	       }
+	  }
+#  endif
+#  if defined(HAVE_POSIX_MEMALIGN) && defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+	  if (!base && !posix_memalign((void **) &base, HUGE_PAGE_SIZE, size)) {
+	       if (!madvise(base, size, MADV_HUGEPAGE))
+		    h.huge = LARGE_MALLOC_TRANSPARENT_HUGE_PAGES;
+	  }
+#  endif
+	  if (h.huge != LARGE_MALLOC_NO_HUGE_PAGES)
+	       h.page_size = HUGE_PAGE_SIZE;
+     }
+#endif
+
+     if (!base) {
+#if !defined(DEBUG_MALLOC) && defined(HAVE_POSIX_MEMALIGN)
+	  if (posix_memalign((void **) &base, 64, n + HEADER_SIZE))
+	       base = NULL;
+#else
+	  base = (char *) malloc(n + HEADER_SIZE);
+#endif
+	  if (!base)
+	       return NULL;
+     }
+
+     h.prev = NULL;
+     h.next = large_arrays;
+     memcpy(base, &h, sizeof(large_header));
+     if (large_arrays)
+	  large_arrays->prev = (large_header *) base;
+     large_arrays = (large_header *) base;
+
+     first_touch(base + HEADER_SIZE, n, h.page_size);
+     return (void *) (base + HEADER_SIZE);
+}
+
+void large_free(void *p)
+{
+     large_header *h;
+
+     if (!p)
+	  return;
+     h = (large_header *) ((char *) p - HEADER_SIZE);
+     if (h->prev)
+	  h->prev->next = h->next;
+     else
+	  large_arrays = h->next;
+     if (h->next)
+	  h->next->prev = h->prev;
+#if !defined(DEBUG_MALLOC) && defined(HAVE_SYS_MMAN_H)
+     if (h->map_size) {
+	  munmap((void *) h, h->map_size);
+	  return;
+     }
+#endif
+     free(h);
+}
+
+#define MAX_NODES 64
+#define SAMPLE_PAGES 64 /* pages sampled per array for the NUMA nodes */
+
+/* Print (on the master process) the total size of the live arrays, how
+   much of it has huge pages (for transparent huge pages, only requested
+   of the kernel), the number of threads that first touched them, and
+   (if libnuma is available) the fraction of their pages, as sampled,
+   on each NUMA node. */
+void large_malloc_report(void)
+{
+     large_header *h;
+     double total = 0, huge = 0;
+     int nthreads = 1;
+#ifdef HAVE_MOVE_PAGES
+     int node_count[MAX_NODES], nsampled = 0, i;
+
+     for (i = 0; i < MAX_NODES; ++i)
+	  node_count[i] = 0;
+#endif
+
+#ifdef USE_OPENMP
+     nthreads = omp_get_max_threads();
+#endif
+
+     for (h = large_arrays; h; h = h->next) {
+	  total += h->n;
+	  if (h->huge != LARGE_MALLOC_NO_HUGE_PAGES)
+	       huge += h->n;
+#ifdef HAVE_MOVE_PAGES
+	  {
+	       void *pages[SAMPLE_PAGES];
+	       int status[SAMPLE_PAGES], j, np = 0;
+	       size_t step = h->n / SAMPLE_PAGES;
+
+	       if (step < SMALL_PAGE_SIZE)
+		    step = SMALL_PAGE_SIZE;
+	       for (j = 0; j < SAMPLE_PAGES && step * j < h->n; ++j)
+		    pages[np++] = (void *)
+			 (((size_t) ((char *) h + HEADER_SIZE + step * j))
+			  & ~((size_t) SMALL_PAGE_SIZE - 1));
+	       if (!move_pages(0, np, pages, NULL, status, 0))
+		    for (j = 0; j < np; ++j)
+			 if (status[j] >= 0 && status[j] < MAX_NODES) {
+			      node_count[status[j]]++;
+			      nsampled++;
+			 }
+	  }
+#endif
+     }
+
+     mpi_one_printf("Large arrays: %g MB, %g MB with huge pages, "
+		    "first touched by %d thread%s\n",
+		    total / 1048576, huge / 1048576,
+		    nthreads, nthreads == 1 ? "" : "s");
+#ifdef HAVE_MOVE_PAGES
+     if (nsampled > 0) {
+	  mpi_one_printf("Large array pages on NUMA nodes:");
+	  for (i = 0; i < MAX_NODES; ++i)
+	       if (node_count[i])
+		    mpi_one_printf(" %d (%0.0f%%)", i,
+				   node_count[i] * 100.0 / nsampled);
+	  mpi_one_printf("\n");
+     }
+#endif
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) 1999-2020 Massachusetts Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LARGE_MALLOC_H
+#define LARGE_MALLOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Allocation of the big solver arrays (the eigenvectors, the FFT
+   buffers, epsilon, k+G...), which are aligned, optionally backed by
+   huge pages, and initialized to zero in parallel (with OpenMP) with
+   the same static thread decomposition as the loops and threaded FFTs
+   over them, so that each page is first touched, and thus placed on
+   the NUMA node of, the thread that will use it.  Arrays allocated by
+   large_malloc must be freed by large_free. */
+
+/* values of mpb_huge_pages: */
+#define LARGE_MALLOC_NO_HUGE_PAGES 0
+#define LARGE_MALLOC_TRANSPARENT_HUGE_PAGES 1 /* madvise(MADV_HUGEPAGE) */
+#define LARGE_MALLOC_EXPLICIT_HUGE_PAGES 2 /* mmap(MAP_HUGETLB), falling
+					      back to transparent */
+
+extern int mpb_huge_pages;
+
+extern void *large_malloc(size_t n);
+extern void large_free(void *p);
+extern void large_malloc_report(void);
+
+#define CHK_LARGE_MALLOC(p, t, n) {                                   \
+     size_t CHK_MALLOC_n_tmp = (n);                                   \
+     (p) = (t *) large_malloc(sizeof(t) * CHK_MALLOC_n_tmp);          \
+     CHECK((p) || CHK_MALLOC_n_tmp == 0, "out of memory!");           \
+}
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* LARGE_MALLOC_H */
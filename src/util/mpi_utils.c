@@ -61,9 +61,12 @@ int mpb_comm = 0;
 static MPI_Comm mpb_comm_save = MPI_COMM_WORLD;
 #endif
 
+static void free_node_comm(void);
+
 void end_divide_parallel(void)
 {
 #ifdef HAVE_MPI
+    free_node_comm();
     if (mpb_comm != MPI_COMM_WORLD) MPI_Comm_free(&mpb_comm);
     if (mpb_comm_save != MPI_COMM_WORLD) MPI_Comm_free(&mpb_comm_save);
     mpb_comm = mpb_comm_save = MPI_COMM_WORLD;
@@ -217,3 +220,107 @@ void mpi_end_critical_section(int tag)
 		   mpb_comm);
      }
 }
+
+/* The following functions allocate read-only data of which a single
+   copy is shared by all of the processes (of mpb_comm) on each node,
+   using MPI-3 shared-memory windows.  mpi_node_shared_malloc is
+   collective, and returns the node's copy of n bytes, where n need
+   only be given on the processes for which mpi_is_node_master() is
+   true.  These processes must write the data, after which all the
+   processes call mpi_node_shared_sync before reading it.  Without
+   MPI-3, every process gets its own copy (and is a "node master").
+   The returned *handle is passed to mpi_node_shared_sync and to
+   mpi_node_shared_free (instead of free). */
+
+#if defined(HAVE_MPI) && defined(MPI_VERSION) && MPI_VERSION >= 3
+#  define HAVE_MPI_SHARED_WINDOWS 1
+
+/* the processes of node_comm_parent on our node, split off the first
+   time that they are needed for a given mpb_comm: */
+static MPI_Comm node_comm = MPI_COMM_NULL;
+static MPI_Comm node_comm_parent = MPI_COMM_NULL;
+
+static MPI_Comm get_node_comm(void)
+{
+     if (node_comm == MPI_COMM_NULL || node_comm_parent != mpb_comm) {
+	  if (node_comm != MPI_COMM_NULL)
+	       MPI_Comm_free(&node_comm);
+	  MPI_Comm_split_type(mpb_comm, MPI_COMM_TYPE_SHARED, 0,
+			      MPI_INFO_NULL, &node_comm);
+	  node_comm_parent = mpb_comm;
+     }
+     return node_comm;
+}
+#endif
+
+/* Forget the cached node communicator, e.g. because mpb_comm is
+   about to be freed (after which its handle may be reused). */
+static void free_node_comm(void)
+{
+#ifdef HAVE_MPI_SHARED_WINDOWS
+     if (node_comm != MPI_COMM_NULL)
+	  MPI_Comm_free(&node_comm);
+     node_comm_parent = MPI_COMM_NULL;
+#endif
+}
+
+/* Return whether we have rank 0 among the processes on our node. */
+int mpi_is_node_master(void)
+{
+#ifdef HAVE_MPI_SHARED_WINDOWS
+     int node_rank;
+     MPI_Comm_rank(get_node_comm(), &node_rank);
+     return (node_rank == 0);
+#else
+     return 1;
+#endif
+}
+
+void *mpi_node_shared_malloc(size_t n, void **handle)
+{
+#ifdef HAVE_MPI_SHARED_WINDOWS
+     MPI_Win *win;
+     MPI_Aint size;
+     int disp_unit;
+     void *data;
+
+     CHK_MALLOC(win, MPI_Win, 1);
+     /* (the default MPI_ERRORS_ARE_FATAL handler aborts if we are out
+	of memory here) */
+     MPI_Win_allocate_shared(mpi_is_node_master() ? (MPI_Aint) n : 0, 1,
+			     MPI_INFO_NULL, get_node_comm(), &data, win);
+     MPI_Win_shared_query(*win, 0, &size, &disp_unit, &data);
+     MPI_Win_fence(0, *win);
+     *handle = (void *) win;
+     return data;
+#else
+     void *data;
+     CHK_MALLOC(data, char, n);
+     *handle = data;
+     return data;
+#endif
+}
+
+void mpi_node_shared_sync(void *handle)
+{
+#ifdef HAVE_MPI_SHARED_WINDOWS
+     /* a fence on a shared-memory window both synchronizes the memory
+	and waits for all of the processes on the node: */
+     MPI_Win_fence(0, *((MPI_Win *) handle));
+#else
+     (void) handle;
+#endif
+}
+
+void mpi_node_shared_free(void *handle)
+{
+#ifdef HAVE_MPI_SHARED_WINDOWS
+     MPI_Win *win = (MPI_Win *) handle;
+     if (win) {
+	  MPI_Win_free(win);
+	  free(win);
+     }
+#else
+     free(handle);
+#endif
+}
@@ -58,6 +58,11 @@ extern void mpi_assert_equal(double x);
 extern void mpi_begin_critical_section(int tag);
 extern void mpi_end_critical_section(int tag);
 
+extern int mpi_is_node_master(void);
+extern void *mpi_node_shared_malloc(size_t n, void **handle);
+extern void mpi_node_shared_sync(void *handle);
+extern void mpi_node_shared_free(void *handle);
+
 /* "in-place" Allreduce wrapper for reducing a single value */
 #define mpi_allreduce_1(b, ctype, t, op, comm) { \
      ctype bbbb = *(b); \
@@ -22,6 +22,8 @@
 
 #include "config.h"
 #include <check.h>
+#include <mpiglue.h>
+#include <mpi_utils.h>
 #include <blasglue.h>
 #include <matrices.h>
 #include <eigensolver.h>
@@ -51,11 +53,13 @@ int feenableexcept (int EXCEPTS);
 #define NUM_FFT_BANDS 5
 
 #define NWORK 3
+#define DAVIDSON_NWORK 9 /* a subspace of 4 (or, with mu, 3) blocks */
 
 #define KX 0.5
 #define EPS_LOW 1.00
 #define EPS_HIGH 9.00
 #define EPS_HIGH_X 0.25
+#define MU_HIGH 2.00 /* mu in the high-index layers, for -D */
 
 #define ERROR_TOL 1e-4
 
@@ -201,6 +205,325 @@ real norm_diff(scalar *a, scalar *b, int n)
 
 /*************************************************************************/
 
+/* checks of the irrep projection, maxwell_irrep_constraint, on an
+   n x n x n cubic grid filled with dielectric spheres: */
+
+#ifdef SCALAR_COMPLEX
+
+typedef struct {
+     int num_spheres;
+     real center[4][3], radius, eps_high;
+} spheres_data;
+
+static void spheres_epsilon(symmetric_matrix *eps, symmetric_matrix *eps_inv,
+			    const real r[3], void *sdata_v)
+{
+     spheres_data *sdata = (spheres_data *) sdata_v;
+     real eps_val = 1.0;
+     int i, a;
+
+     for (i = 0; i < sdata->num_spheres; ++i) {
+	  real r2 = 0.0;
+	  for (a = 0; a < 3; ++a) {
+	       real dr = r[a] - sdata->center[i][a];
+	       dr -= floor(dr + 0.5); /* nearest periodic image */
+	       r2 += dr * dr;
+	  }
+	  if (r2 < sdata->radius * sdata->radius)
+	       eps_val = sdata->eps_high;
+     }
+     eps->m00 = eps->m11 = eps->m22 = eps_val;
+     eps_inv->m00 = eps_inv->m11 = eps_inv->m22 = 1.0 / eps_val;
+#ifdef WITH_HERMITIAN_EPSILON
+     CASSIGN_ZERO(eps->m01);
+     CASSIGN_ZERO(eps->m02);
+     CASSIGN_ZERO(eps->m12);
+     CASSIGN_ZERO(eps_inv->m01);
+     CASSIGN_ZERO(eps_inv->m02);
+     CASSIGN_ZERO(eps_inv->m12);
+#else
+     eps->m01 = eps->m02 = eps->m12 = 0.0;
+     eps_inv->m01 = eps_inv->m02 = eps_inv->m12 = 0.0;
+#endif
+}
+
+/* Zero the planewaves whose orbit leaves the grid; this is the
+   projection Q onto the space in which the irrep projections P act,
+   so that P = P Q = Q P. */
+static void irrep_grid_project(evectmatrix X, const maxwell_irrep_data *id)
+{
+     int i, b;
+     for (i = 0; i < X.localN; ++i)
+	  if (!id->in_grid[i])
+	       for (b = 0; b < X.c * X.p; ++b)
+		    ASSIGN_ZERO(X.data[i * X.c * X.p + b]);
+}
+
+/* Check, for each of the num_irreps irreps of the group of the num_ops
+   operations {W|w} (as in create_maxwell_irrep_data), with characters
+   chi[num_ops * j ...] for irrep j, that the projection P onto it is
+   nonzero, idempotent and commutes with Q A Q (the Maxwell operator
+   restricted to the orbit-closed planewaves), and that the projections
+   sum to Q.  If zparity is nonzero, the group must be {E, m_z} and P
+   is also compared with maxwell_zparity_constraint for parity zparity
+   (irrep 0) and -zparity (irrep 1).  X, Y, Z, T and S are scratch. */
+static void check_irrep_group(const char *name, maxwell_data *md,
+			      real R[3][3], int num_ops,
+			      const real *W, const real *w,
+			      int num_irreps, const scalar_complex *chi,
+			      int zparity,
+			      evectmatrix X, evectmatrix Y, evectmatrix Z,
+			      evectmatrix T, evectmatrix S)
+{
+     maxwell_irrep_data *id = NULL;
+     real xmag = 0.0, mag, err;
+     int i, j;
+
+     printf("\nChecking the irrep projections of %s...\n", name);
+     for (i = 0; i < X.n * X.p; ++i) {
+	  ASSIGN_SCALAR(X.data[i], rand() * 1.0 / RAND_MAX - 0.5,
+			rand() * 1.0 / RAND_MAX - 0.5);
+	  ASSIGN_ZERO(S.data[i]);
+	  xmag += SCALAR_NORMSQR(X.data[i]);
+     }
+
+     for (j = 0; j < num_irreps; ++j) {
+	  destroy_maxwell_irrep_data(id);
+	  id = create_maxwell_irrep_data(md, R, num_ops, W, w,
+					 chi + num_ops * j);
+	  maxwell_irrep_set_k(id);
+
+	  /* Y = P X must be nonzero, with P Y = Y: */
+	  evectmatrix_copy(Y, X);
+	  maxwell_irrep_constraint(Y, id);
+	  mag = 0.0;
+	  for (i = 0; i < Y.n * Y.p; ++i) {
+	       mag += SCALAR_NORMSQR(Y.data[i]);
+	       ASSIGN_SCALAR(S.data[i],
+			     SCALAR_RE(S.data[i]) + SCALAR_RE(Y.data[i]),
+			     SCALAR_IM(S.data[i]) + SCALAR_IM(Y.data[i]));
+	  }
+	  mag = sqrt(mag / xmag);
+	  evectmatrix_copy(Z, Y);
+	  maxwell_irrep_constraint(Z, id);
+	  err = norm_diff(Z.data, Y.data, Y.n * Y.p);
+	  printf("irrep %d: |P X| / |X| = %g, |P P X - P X| / |P X| = %e\n",
+		 j, mag, err);
+	  CHECK(mag > 0.05, "projection onto the irrep is (nearly) zero");
+	  CHECK(err < 1e-10, "irrep projection is not idempotent");
+
+	  if (zparity) {
+	       int parity = (j == 0) == (zparity > 0) ?
+		    EVEN_Z_PARITY : ODD_Z_PARITY;
+	       evectmatrix_copy(T, X);
+	       set_maxwell_data_parity(md, parity);
+	       maxwell_zparity_constraint(T, md);
+	       set_maxwell_data_parity(md, NO_PARITY);
+	       irrep_grid_project(T, id);
+	       err = norm_diff(T.data, Y.data, Y.n * Y.p);
+	       printf("irrep %d: |P X - zparity %s| / |P X| = %e\n", j,
+		      parity == EVEN_Z_PARITY ? "even" : "odd", err);
+	       CHECK(err < 1e-10, "irrep projection disagrees with "
+		     "maxwell_zparity_constraint");
+	  }
+
+	  /* Z = Q A Q P X = Q A P X and Y = P Q A Q X must agree: */
+	  maxwell_operator(Y, Z, md, 0, T);
+	  irrep_grid_project(Z, id);
+	  evectmatrix_copy(T, X);
+	  irrep_grid_project(T, id);
+	  maxwell_operator(T, Y, md, 0, T);
+	  irrep_grid_project(Y, id);
+	  maxwell_irrep_constraint(Y, id);
+	  err = norm_diff(Y.data, Z.data, Z.n * Z.p);
+	  printf("irrep %d: |[P, Q A Q] X| / |Q A Q P X| = %e\n", j, err);
+	  CHECK(err < 1e-10, "irrep projection does not commute with "
+		"the Maxwell operator");
+     }
+
+     /* the projections onto all the irreps sum to Q: */
+     evectmatrix_copy(T, X);
+     irrep_grid_project(T, id);
+     err = norm_diff(S.data, T.data, T.n * T.p);
+     printf("|sum of P X - Q X| / |Q X| = %e\n", err);
+     CHECK(err < 1e-10, "irrep projections do not sum to the identity");
+
+     destroy_maxwell_irrep_data(id);
+}
+
+#define IRREP_NUM_BANDS 2
+
+/* Check the irrep projections for the mirror group {E, m_z} (against
+   maxwell_zparity_constraint) and for the nonsymmorphic group of a 4_1
+   screw axis, {C_4^j | (0,0,j/4)}, j = 0..3, of a helix of spheres. */
+static void check_irreps(int n)
+{
+     maxwell_data *md;
+     int local_N, N_start, alloc_N, mesh[3] = {3,3,3}, i, j;
+     real R[3][3] = { {1,0,0}, {0,1,0}, {0,0,1} };
+     real G[3][3] = { {1,0,0}, {0,1,0}, {0,0,1} };
+     evectmatrix X[5];
+     spheres_data sd;
+
+     md = create_maxwell_data(n, n, n, &local_N, &N_start, &alloc_N,
+			      IRREP_NUM_BANDS, IRREP_NUM_BANDS);
+     CHECK(md, "NULL mdata");
+     for (i = 0; i < 5; ++i)
+	  X[i] = create_evectmatrix(n * n * n, 2, IRREP_NUM_BANDS,
+				    local_N, N_start, alloc_N);
+     sd.eps_high = 12.0;
+
+     {
+	  real W[2*9] = { 1,0,0, 0,1,0, 0,0,1,
+			  1,0,0, 0,1,0, 0,0,-1 };
+	  real w[2*3] = { 0,0,0, 0,0,0 };
+	  scalar_complex chi[2*2];
+	  real k[3] = { 0.2, 0.1, 0.0 };
+
+	  for (j = 0; j < 2; ++j) {
+	       CASSIGN_SCALAR(chi[2*j], 1.0, 0.0);
+	       CASSIGN_SCALAR(chi[2*j + 1], j ? -1.0 : 1.0, 0.0);
+	  }
+	  sd.num_spheres = 1;
+	  sd.center[0][0] = 0.25; sd.center[0][1] = 0.125;
+	  sd.center[0][2] = 0.0;
+	  sd.radius = 0.2;
+	  update_maxwell_data_k(md, k, G[0], G[1], G[2]);
+	  set_maxwell_dielectric(md, mesh, R, G, spheres_epsilon, 0, &sd);
+	  check_irrep_group("the mirror group {E, m_z}", md, R, 2, W, w,
+			    2, chi, +1, X[0], X[1], X[2], X[3], X[4]);
+     }
+
+     {
+	  real W[4*9], w[4*3];
+	  scalar_complex chi[4*4];
+	  real k[3] = { 0.0, 0.0, 0.3 }, a = 0.25;
+
+	  /* the j-th power of {C_4 | (0,0,1/4)}; since its 4th power is
+	     a lattice translation, with phase exp(-2 pi i k_z) on Bloch
+	     states, the characters of the 4 irreps of its cyclic group
+	     are chi(g^j) = exp(i pi j (m - k_z) / 2) for m = 0..3: */
+	  for (j = 0; j < 4; ++j) {
+	       real C[4][2] = { {1,0}, {0,1}, {-1,0}, {0,-1} }; /* C_4^j */
+	       int m;
+	       for (i = 0; i < 9; ++i)
+		    W[9*j + i] = 0.0;
+	       W[9*j + 0] = C[j][0]; W[9*j + 1] = -C[j][1];
+	       W[9*j + 3] = C[j][1]; W[9*j + 4] = C[j][0];
+	       W[9*j + 8] = 1.0;
+	       w[3*j] = w[3*j + 1] = 0.0;
+	       w[3*j + 2] = j * 0.25;
+	       for (m = 0; m < 4; ++m) {
+		    real phi = 0.5 * (TWOPI/2) * j * (m - k[2]);
+		    CASSIGN_SCALAR(chi[4*m + j], cos(phi), sin(phi));
+	       }
+	       sd.center[j][0] = a * C[j][0];
+	       sd.center[j][1] = a * C[j][1];
+	       sd.center[j][2] = j * 0.25;
+	  }
+	  sd.num_spheres = 4;
+	  sd.radius = 0.15;
+	  update_maxwell_data_k(md, k, G[0], G[1], G[2]);
+	  set_maxwell_dielectric(md, mesh, R, G, spheres_epsilon, 0, &sd);
+	  check_irrep_group("the 4_1 screw group", md, R, 4, W, w,
+			    4, chi, 0, X[0], X[1], X[2], X[3], X[4]);
+     }
+
+     for (i = 0; i < 5; ++i)
+	  destroy_evectmatrix(X[i]);
+     destroy_maxwell_data(md);
+}
+
+#endif /* SCALAR_COMPLEX */
+
+/*************************************************************************/
+
+/* Integrate a real scalar field over the cell of volume vol, counting
+   the points implied by the rfftw output symmetry of an mpbi (real
+   fields) calculation, as in compute_field_energy_internal. */
+static double integrate_scalarfield(maxwell_data *d, const real *f, real vol)
+{
+     int i, last_dim_stored =
+	  d->last_dim_size / (sizeof(scalar_complex)/sizeof(scalar));
+     double sum = 0;
+
+     for (i = 0; i < d->fft_output_size; ++i) {
+	  int count = 1;
+#ifndef SCALAR_COMPLEX
+	  int last_index;
+#  ifdef HAVE_MPI
+	  if (d->nz == 1) /* 2d: 1st dim. is truncated one */
+	       last_index = i / d->nx + d->local_y_start;
+	  else
+	       last_index = i % last_dim_stored;
+#  else
+	  last_index = i % last_dim_stored;
+#  endif
+	  if (last_index != 0 && 2*last_index != d->last_dim)
+	       count = 2;
+#else
+	  (void) last_dim_stored;
+#endif
+	  sum += count * f[i];
+     }
+     mpi_allreduce_1(&sum, double, MPI_DOUBLE, MPI_SUM, mpb_comm);
+     return sum * vol / d->N;
+}
+
+#define LDOS_NBINS 1000
+
+/* Check the normalization of the density of states of the bands H
+   (with eigenvalues eigvals) accumulated by maxwell_accumulate_ldos,
+   without and with Gaussian broadening.  Each band adds weight/df to
+   the DOS of its bins, so the DOS must sum to num_bands * weight / df.
+   The spatial LDOS of each band integrates to one over the cell, so
+   that of each bin must integrate to its DOS; the bins are narrow, so
+   that this checks the bands one (degenerate pair) at a time. */
+static void check_ldos(maxwell_data *md, evectmatrix H, evectmatrix W,
+		       const real *eigvals, real vol)
+{
+     const real weight = 0.5;
+     real *freqs, fmax = 0, df;
+     int i, j, ib;
+
+     printf("\nChecking the LDOS and DOS normalization...\n");
+     CHK_MALLOC(freqs, real, H.p);
+     for (i = 0; i < H.p; ++i) {
+	  freqs[i] = sqrt(eigvals[i]);
+	  if (freqs[i] > fmax)
+	       fmax = freqs[i];
+     }
+     df = 2 * fmax / LDOS_NBINS; /* bins from -fmax/2 to 3fmax/2 */
+
+     for (ib = 0; ib <= 1; ++ib) {
+	  maxwell_ldos_data *ld;
+	  double dos_sum = 0, max_err = 0, err;
+
+	  ld = create_maxwell_ldos_data(md, LDOS_NBINS, -0.5 * fmax,
+					1.5 * fmax, ib * 2 * df, 1);
+	  maxwell_accumulate_ldos(ld, H, W, freqs, vol, weight);
+	  for (j = 0; j < LDOS_NBINS; ++j) {
+	       double integral = integrate_scalarfield(
+		    md, ld->ldos + j * md->fft_output_size, vol);
+	       dos_sum += ld->dos[j];
+	       err = fabs(integral - ld->dos[j]) * df / weight;
+	       if (err > max_err)
+		    max_err = err;
+	  }
+	  printf("broadening %g: sum of DOS * df / weight = %g (%d bands), "
+		 "max. |LDOS integral - DOS| * df / weight = %e\n",
+		 ld->broadening, dos_sum * df / weight, H.p, max_err);
+	  CHECK(fabs(dos_sum * df / weight - H.p) < 1e-5 * H.p,
+		"DOS does not sum to the number of bands");
+	  CHECK(max_err < 1e-6, "LDOS of a band does not integrate to one");
+	  destroy_maxwell_ldos_data(ld);
+     }
+
+     free(freqs);
+}
+
+/*************************************************************************/
+
 void usage(void)
 {
      printf("Syntax: maxwell_test [options]\n"
@@ -219,8 +542,15 @@ void usage(void)
 	    "   -t <freq>    Set target frequency [dflt. none].\n"
 	    "   -c <tol>     Set convergence tolerance [dflt. %e].\n"
 	    "   -g <NMESH>   Set mesh size [dflt. %d].\n"
+	    "   -C <cutoff>  Set planewave cutoff [dflt. none].\n"
+	    "   -I <n>       Check the irrep projections on an n^3 grid.\n"
+	    "   -L           Check the normalization of the LDOS and DOS.\n"
+	    "   -D           Check the Davidson solver against conj. grad.,\n"
+	    "                without and with mu.\n"
 	    "   -1           Stop after first computation.\n"
 	    "   -p           Use simple preconditioner.\n"
+	    "   -l           Use the local epsilon tensor in the preconditioner.\n"
+	    "   -d           Distribute the dense p x p products (with MPI).\n"
 	    "   -E <err>     Exit with error if the error exceeds <err>\n"
 	    "   -v           Verbose output.\n",
 	    KX, NUM_BANDS, sqrt(EPS_HIGH), EPS_HIGH_X, NX, NY, NZ,
@@ -233,7 +563,9 @@ int main(int argc, char **argv)
 {
      maxwell_data *mdata;
      maxwell_target_data *mtdata = NULL;
-     int local_N, N_start, alloc_N;
+     int N, local_N, N_start, alloc_N;
+     real planewave_cutoff = 0.0;
+     int check_davidson = 0;
      real R[3][3] = { {1,0,0}, {0,0.01,0}, {0,0,0.01} };
      real G[3][3] = { {1,0,0}, {0,100,0}, {0,0,100} };
      real kvector[3] = {KX,0,0};
@@ -255,7 +587,11 @@ int main(int argc, char **argv)
      int stop1 = 0;
      int verbose = 0;
      int which_preconditioner = 2;
+     int precond_eps_tensor = 0;
+     int eig_flags = EIGS_DEFAULT_FLAGS;
      double max_err = 1e20;
+     int irrep_n = 0;
+     int check_ldos_norm = 0;
 
      srand(time(NULL));
 
@@ -274,7 +610,7 @@ int main(int argc, char **argv)
           extern int optind;
           int c;
 
-          while ((c = getopt(argc, argv, "hs:k:b:n:f:x:y:z:emt:c:g:1pvE:"))
+          while ((c = getopt(argc, argv, "hs:k:b:n:f:x:y:z:emt:c:g:C:I:LD1pldvE:"))
 		 != -1)
 	       switch (c) {
 		   case 'h':
@@ -333,12 +669,31 @@ int main(int argc, char **argv)
 			mesh_size = atoi(optarg);
 			CHECK(mesh_size > 0, "mesh size must be positive");
 			break;
+		   case 'C':
+			planewave_cutoff = atof(optarg);
+			break;
+		   case 'I':
+			irrep_n = atoi(optarg);
+			CHECK(irrep_n > 0, "irrep grid size must be positive");
+			break;
+		   case 'L':
+			check_ldos_norm = 1;
+			break;
+		   case 'D':
+			check_davidson = 1;
+			break;
 		   case '1':
 			stop1 = 1;
 			break;
 		   case 'p':
 			which_preconditioner = 1;
 			break;
+		   case 'l':
+			precond_eps_tensor = 1;
+			break;
+		   case 'd':
+			eig_flags |= EIGS_DISTRIBUTE_PRODUCTS;
+			break;
 		   case 'v':
 			verbose = 1;
 			break;
@@ -364,8 +719,13 @@ int main(int argc, char **argv)
      mdata = create_maxwell_data(nx, ny, nz, &local_N, &N_start, &alloc_N,
 				 num_bands, NUM_FFT_BANDS);
      CHECK(mdata, "NULL mdata");
+     maxwell_set_planewave_cutoff(mdata, planewave_cutoff,
+				  &N, &local_N, &N_start, &alloc_N);
+     if (mdata->grid_planewave)
+	  printf("Using %d of %d planewaves.\n", N, nx * ny * nz);
 
      set_maxwell_data_parity(mdata, parity);
+     mdata->precond_eps_tensor = precond_eps_tensor;
 
      printf("Setting k vector to (%g, %g, %g)...\n",
 	    kvector[0], kvector[1], kvector[2]);
@@ -391,12 +751,12 @@ int main(int argc, char **argv)
      }
 
      printf("Allocating fields...\n");
-     H = create_evectmatrix(nx * ny * nz, 2, num_bands,
+     H = create_evectmatrix(N, 2, num_bands,
 			    local_N, N_start, alloc_N);
-     Hstart = create_evectmatrix(nx * ny * nz, 2, num_bands,
+     Hstart = create_evectmatrix(N, 2, num_bands,
 				 local_N, N_start, alloc_N);
      for (i = 0; i < NWORK; ++i)
-	  W[i] = create_evectmatrix(nx * ny * nz, 2, num_bands,
+	  W[i] = create_evectmatrix(N, 2, num_bands,
 				    local_N, N_start, alloc_N);
 
      CHK_MALLOC(eigvals, real, num_bands);
@@ -436,7 +796,7 @@ int main(int argc, char **argv)
 		 op, op_data, NULL,NULL,
 		 pre_op, pre_op_data,
 		 maxwell_parity_constraint, (void *) mdata,
-		 W, NWORK, error_tol, &num_iters, EIGS_DEFAULT_FLAGS);
+		 W, NWORK, error_tol, &num_iters, eig_flags);
 
      if (do_target)
 	  eigensolver_get_eigenvals(H, eigvals, maxwell_operator, mdata,
@@ -474,6 +834,100 @@ int main(int argc, char **argv)
      }
      }
 
+     /*****************************************/
+     if (irrep_n > 0) {
+#ifdef SCALAR_COMPLEX
+	  check_irreps(irrep_n);
+#else
+	  printf("\nIrrep projection is not implemented for mpbi, "
+		 "skipping.\n");
+#endif
+     }
+
+     /*****************************************/
+     if (check_ldos_norm)
+	  check_ldos(mdata, H, W[0], eigvals, R[0][0] * R[1][1] * R[2][2]);
+
+     /*****************************************/
+     if (check_davidson) {
+	  evectmatrix Wd[DAVIDSON_NWORK];
+	  real *deigvals;
+	  epsilon_data mud = ed;
+	  int with_mu, cg_iters;
+
+	  /* Solve with eigensolver and eigensolver_davidson from the same
+	     starting fields, first for the structure as is and then with
+	     mu = MU_HIGH in the high-index layers (so that Davidson keeps
+	     a B-orthonormal basis), and compare the eigenvalues. */
+	  for (i = 0; i < DAVIDSON_NWORK; ++i)
+	       Wd[i] = create_evectmatrix(N, 2, num_bands,
+					  local_N, N_start, alloc_N);
+	  CHK_MALLOC(deigvals, real, num_bands);
+	  mud.eps_high = MU_HIGH;
+	  for (with_mu = 0; with_mu <= 1; ++with_mu) {
+	       maxwell_data *dd = mdata;
+	       evectoperator B = NULL;
+
+	       if (with_mu) {
+		    dd = create_maxwell_data(nx, ny, nz, &local_N, &N_start,
+					     &alloc_N, num_bands,
+					     NUM_FFT_BANDS);
+		    maxwell_set_planewave_cutoff(dd, planewave_cutoff, &N,
+						 &local_N, &N_start, &alloc_N);
+		    set_maxwell_data_parity(dd, parity);
+		    update_maxwell_data_k(dd, kvector, G[0], G[1], G[2]);
+		    set_maxwell_dielectric(dd, mesh, R, G, epsilon, 0, &ed);
+		    set_maxwell_mu(dd, mesh, R, G, epsilon, 0, &mud);
+		    B = maxwell_muinv_operator;
+	       }
+	       printf("\nChecking the Davidson solver%s...\n",
+		      with_mu ? " with mu" : "");
+
+	       evectmatrix_copy(H, Hstart);
+	       eigensolver(H, eigvals,
+			   maxwell_operator, (void *) dd, B, (void *) dd,
+			   which_preconditioner == 1 ?
+			   maxwell_preconditioner : maxwell_preconditioner2,
+			   (void *) dd,
+			   maxwell_parity_constraint, (void *) dd,
+			   W, NWORK, error_tol, &cg_iters, EIGS_DEFAULT_FLAGS);
+
+	       evectmatrix_copy(H, Hstart);
+	       eigensolver_davidson(H, deigvals,
+				    maxwell_operator, (void *) dd,
+				    B, (void *) dd,
+				    which_preconditioner == 1 ?
+				    maxwell_preconditioner :
+				    maxwell_preconditioner2,
+				    (void *) dd,
+				    maxwell_parity_constraint, (void *) dd,
+				    Wd, DAVIDSON_NWORK, error_tol, &num_iters,
+				    EIGS_DEFAULT_FLAGS, 0.0);
+
+	       printf("Solved after %d (conj. grad.) and %d (Davidson) "
+		      "iterations.\n", cg_iters, num_iters);
+	       printf("%15s%15s%15s\n", "conj. grad.", "Davidson",
+		      "difference");
+	       for (i = 0; i < num_bands; ++i) {
+		    /* relative to the largest eigenvalue, in case of zeros;
+		       both solvers stop when the relative change of the
+		       eigenvalues per iteration is below error_tol, so
+		       their errors can be a few orders of magnitude larger: */
+		    double diff = fabs(deigvals[i] - eigvals[i])
+			 / fabs(eigvals[num_bands - 1]);
+		    printf("%15f%15f%15e\n", eigvals[i], deigvals[i], diff);
+		    CHECK(diff <= 100 * error_tol,
+			  "Davidson eigenvalue differs from conj. grad.");
+	       }
+
+	       if (with_mu)
+		    destroy_maxwell_data(dd);
+	  }
+	  free(deigvals);
+	  for (i = 0; i < DAVIDSON_NWORK; ++i)
+	       destroy_evectmatrix(Wd[i]);
+     }
+
      if (!stop1) {
 
      /*****************************************/
@@ -484,7 +938,7 @@ int main(int argc, char **argv)
 		 op, op_data, NULL,NULL,
 		 NULL, NULL,
 		 maxwell_parity_constraint, (void *) mdata,
-		 W, NWORK, error_tol, &num_iters, EIGS_DEFAULT_FLAGS);
+		 W, NWORK, error_tol, &num_iters, eig_flags);
 
      if (do_target)
 	  eigensolver_get_eigenvals(H, eigvals, maxwell_operator, mdata,
@@ -513,7 +967,7 @@ int main(int argc, char **argv)
 		 op, op_data, NULL,NULL,
 		 pre_op, pre_op_data,
 		 maxwell_parity_constraint, (void *) mdata,
-		 W, NWORK - 1, error_tol, &num_iters, EIGS_DEFAULT_FLAGS);
+		 W, NWORK - 1, error_tol, &num_iters, eig_flags);
 
      if (do_target)
 	  eigensolver_get_eigenvals(H, eigvals, maxwell_operator, mdata,
@@ -541,7 +995,7 @@ int main(int argc, char **argv)
 		 op, op_data,
 		 NULL, NULL, NULL,NULL,
 		 maxwell_parity_constraint, (void *) mdata,
-		 W, NWORK - 1, error_tol, &num_iters, EIGS_DEFAULT_FLAGS);
+		 W, NWORK - 1, error_tol, &num_iters, eig_flags);
 
      if (do_target)
 	  eigensolver_get_eigenvals(H, eigvals, maxwell_operator, mdata,